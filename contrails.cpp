@@ -0,0 +1,306 @@
+//|___________________________________________________________________
+//!
+//! \file contrails.cpp
+//!
+//! \brief History trails behind the aircraft implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+
+#include "contrails.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float TAIL_Z     = -1.0f;   // Tail of the plane model along its local Z
+const int   FADE_SIZE  = 256;     // Texels of the alpha ramp
+const int   FADE_ALPHA = 200;     // Alpha at the newest end of a trail
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::Contrails
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+Contrails::Contrails()
+  : aircraft_(0), length_(MIN_LENGTH), fade_texture_(0), first_(0), count_(0), serial_(0),
+    sample_(false), last_sample_ms_(0), window_start_ms_(0), window_vertices_(0), now_ms_(0)
+{
+  stats_ = ContrailStats();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::Init
+//|
+//! \param aircraft    [in] Number of aircraft.
+//! \param length      [in] Trail length in samples.
+//! \return None.
+//|____________________________________________________________________
+
+void Contrails::Init(size_t aircraft, int length)
+{
+  aircraft_ = aircraft;
+
+  last_x_.assign(aircraft_, 0.0f);
+  last_y_.assign(aircraft_, 0.0f);
+  last_z_.assign(aircraft_, 0.0f);
+  tail_x_.assign(aircraft_, 0.0f);
+  tail_y_.assign(aircraft_, 0.0f);
+  tail_z_.assign(aircraft_, 0.0f);
+
+  sample_offset_.assign(MAX_LENGTH, 0);
+  first_  = 0;
+  count_  = 0;
+  serial_ = 0;
+
+  SetLength(length);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::InitGL
+//|
+//! \param None.
+//! \return None.
+//!
+//! Alpha ramp from transparent (oldest end, s = 0) to FADE_ALPHA (newest
+//! end, s = 1). Clamped, so the current tail piece at s = 1 is opaque too.
+//|____________________________________________________________________
+
+void Contrails::InitGL()
+{
+  unsigned char ramp[FADE_SIZE];
+  for (int i = 0; i < FADE_SIZE; ++i) ramp[i] = (unsigned char) (FADE_ALPHA * i / (FADE_SIZE - 1));
+
+  glGenTextures(1, &fade_texture_);
+  glBindTexture(GL_TEXTURE_1D, fade_texture_);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_ALPHA, FADE_SIZE, 0, GL_ALPHA, GL_UNSIGNED_BYTE, ramp);
+  glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::SetLength
+//|
+//! \param length      [in] Trail length in samples.
+//! \return None.
+//|____________________________________________________________________
+
+void Contrails::SetLength(int length)
+{
+  length_ = std::max((int) MIN_LENGTH, std::min(length, (int) MAX_LENGTH));
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::RingBytes
+//|
+//! \param None.
+//! \return Stream buffer size for MAX_LENGTH live samples, plus the
+//!         released ones the GPU may still be drawing.
+//|____________________________________________________________________
+
+size_t Contrails::RingBytes() const
+{
+  return (MAX_LENGTH + SLACK) * BlockBytes();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::BeginFrame
+//|
+//! \param now_ms  [in] Current time in ms.
+//! \return None.
+//|____________________________________________________________________
+
+void Contrails::BeginFrame(int now_ms)
+{
+  now_ms_ = now_ms;
+  sample_ = (now_ms - last_sample_ms_ >= SAMPLE_MS);
+  if (sample_) last_sample_ms_ = now_ms;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::Record
+//|
+//! \param aircraft    [in] Aircraft index.
+//! \param pose        [in] Current pose of the aircraft.
+//! \return None.
+//|____________________________________________________________________
+
+void Contrails::Record(size_t aircraft, const gmtl::Matrix44f& pose)
+{
+  const float* m = pose.mData;
+
+  // Tail = pose * (0, 0, TAIL_Z, 1)
+  tail_x_[aircraft] = m[8]  * TAIL_Z + m[12];
+  tail_y_[aircraft] = m[9]  * TAIL_Z + m[13];
+  tail_z_[aircraft] = m[10] * TAIL_Z + m[14];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::Stream
+//|
+//! \param buffer  [in] Stream buffer, between its BeginFrame and EndFrame.
+//! \return None.
+//!
+//! A sample is one block in the buffer: for each aircraft, the segment
+//! from its last sample position to its current tail.
+//|____________________________________________________________________
+
+void Contrails::Stream(StreamBuffer& buffer)
+{
+  int appended = 0;
+
+  // Samples that left the trails (one more to make room for a new one)
+  int keep = sample_ ? length_ - 1 : length_;
+  while (count_ > keep) {
+    buffer.Release(sample_offset_[first_]);
+    first_ = (first_ + 1) % MAX_LENGTH;
+    --count_;
+  }
+
+  if (sample_) {
+    size_t          offset;
+    ContrailVertex* v = (ContrailVertex*) buffer.Allocate(BlockBytes(), offset);
+
+    if (v) {
+      // The very first sample has no previous position, its segments are points
+      if (serial_ == 0) {
+        last_x_ = tail_x_;
+        last_y_ = tail_y_;
+        last_z_ = tail_z_;
+      }
+      ++serial_;
+
+      for (size_t a = 0; a < aircraft_; ++a) {
+        ContrailVertex& v0 = *v++;
+        v0.pos[0] = last_x_[a]; v0.pos[1] = last_y_[a]; v0.pos[2] = last_z_[a];
+        v0.sample = (float) (serial_ - 1);
+
+        ContrailVertex& v1 = *v++;
+        v1.pos[0] = tail_x_[a]; v1.pos[1] = tail_y_[a]; v1.pos[2] = tail_z_[a];
+        v1.sample = (float) serial_;
+      }
+      buffer.Commit();
+
+      last_x_ = tail_x_;
+      last_y_ = tail_y_;
+      last_z_ = tail_z_;
+
+      sample_offset_[(first_ + count_) % MAX_LENGTH] = offset;
+      ++count_;
+      appended = (int) aircraft_ * 2;
+    }
+  }
+
+  // Throughput over (at least) one second windows
+  stats_.appended   = appended;
+  stats_.resident   = count_ * (int) aircraft_ * 2;
+  window_vertices_ += appended;
+
+  if (now_ms_ - window_start_ms_ >= 1000) {
+    stats_.appended_per_sec = window_vertices_ * 1000.0 / (now_ms_ - window_start_ms_);
+    window_start_ms_ = now_ms_;
+    window_vertices_ = 0;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Contrails::Draw
+//|
+//! \param viewport    [in] Viewport to draw in.
+//! \param buffer      [in] Buffer the trails were appended to.
+//! \param stats       [in,out] Frame counters the draws are added to.
+//! \return None.
+//!
+//! Consecutive samples are contiguous in the buffer, so the trails take
+//! one glDrawArrays, or two when the live window wraps around the ring.
+//|____________________________________________________________________
+
+void Contrails::Draw(const Viewport& viewport, const StreamBuffer& buffer, RenderStats& stats) const
+{
+  if (!count_) return;
+
+  LoadViewport(viewport);
+
+  // Window [serial_ - count_, serial_] onto the ramp [0, 1]
+  glMatrixMode(GL_TEXTURE);
+  glLoadIdentity();
+  glScalef(1.0f / count_, 1.0f, 1.0f);
+  glTranslatef((float) -(serial_ - count_), 0.0f, 0.0f);
+  glMatrixMode(GL_MODELVIEW);
+
+  // Translucent: blended, and not hiding what is drawn after
+  glEnable(GL_TEXTURE_1D);
+  glBindTexture(GL_TEXTURE_1D, fade_texture_);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(GL_FALSE);
+  glColor4ub(255, 255, 255, 255);
+
+  buffer.Bind();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  const size_t block = BlockBytes();
+  int runs = 0;
+
+  for (int i = 0; i < count_; ) {
+    // Longest run of samples following each other in the buffer
+    size_t offset = sample_offset_[(first_ + i) % MAX_LENGTH];
+    int    n      = 1;
+    while (i + n < count_ && sample_offset_[(first_ + i + n) % MAX_LENGTH] == offset + n * block) ++n;
+
+    glVertexPointer(3, GL_FLOAT, sizeof(ContrailVertex), buffer.Pointer(offset));
+    glTexCoordPointer(1, GL_FLOAT, sizeof(ContrailVertex), buffer.Pointer(offset + 3 * sizeof(float)));
+    glDrawArrays(GL_LINES, 0, n * (int) aircraft_ * 2);
+
+    i += n;
+    ++runs;
+  }
+
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  buffer.Unbind();
+
+  // From the last sample to where the tails are now
+  glBegin(GL_LINES);
+  glTexCoord1f((float) serial_);
+  for (size_t a = 0; a < aircraft_; ++a) {
+    glVertex3f(last_x_[a], last_y_[a], last_z_[a]);
+    glVertex3f(tail_x_[a], tail_y_[a], tail_z_[a]);
+  }
+  glEnd();
+
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  glDisable(GL_TEXTURE_1D);
+
+  glMatrixMode(GL_TEXTURE);
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+
+  // Viewport setup, texture matrix, switch to faded lines and back, the runs + the tail pieces
+  ++stats.viewport_changes;
+  stats.matrix_loads     += 2;
+  stats.pipeline_changes += 2;
+  stats.draw_calls       += runs + 1;
+}
@@ -0,0 +1,119 @@
+//|___________________________________________________________________
+//!
+//! \file contrails.h
+//!
+//! \brief History trails behind the aircraft.
+//!
+//! Every SAMPLE_MS each aircraft appends one line segment, from its
+//! previous tail position to the current one, to a StreamBuffer ring. The
+//! segments stay there: a trail is the live window of the last Length()
+//! samples, drawn in place, and samples falling out of it are released
+//! to the ring. Vertices carry their sample number as a texture
+//! coordinate; the texture matrix maps the window onto a 1D alpha ramp,
+//! so trails fade with age without being rewritten. The short piece from
+//! the last sample to the current tail is drawn in immediate mode.
+//|___________________________________________________________________
+
+#ifndef CONTRAILS_H
+#define CONTRAILS_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <gmtl/gmtl.h>
+
+#include "render_queue.h"
+#include "stream_buffer.h"
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+struct ContrailVertex
+{
+  float pos[3];
+  float sample;                // Sample number, fade texture coordinate
+};
+
+struct ContrailStats
+{
+  int    appended;             // Vertices appended last frame
+  double appended_per_sec;     // Vertices appended over the last second
+  int    resident;             // Vertices of the live trails in the ring
+};
+
+//|____________________________________________________________________
+//|
+//| Class: Contrails
+//|____________________________________________________________________
+
+class Contrails
+{
+public:
+  static const int MIN_LENGTH = 2;      // Trail length range, in samples
+  static const int MAX_LENGTH = 1024;
+  static const int SAMPLE_MS  = 50;     // Time between two trail samples
+  static const int SLACK      = 4;      // Released samples the GPU may still read
+
+  Contrails();
+
+  void Init(size_t aircraft, int length);
+  void InitGL();                        // Creates the fade texture, needs a current GL context
+
+  //! Changes the trail length (clamped to [MIN_LENGTH, MAX_LENGTH]).
+  //! Longer trails grow with the next samples, shorter ones drop their
+  //! oldest samples at the next Stream().
+  void SetLength(int length);
+  int  Length() const { return length_; }
+
+  //! Bytes a StreamBuffer needs to hold MAX_LENGTH samples of all trails.
+  size_t RingBytes() const;
+
+  void BeginFrame(int now_ms);                               // Decides whether this frame takes a sample
+  void Record(size_t aircraft, const gmtl::Matrix44f& pose); // Current pose of each aircraft, once per frame
+
+  //! On sample frames, appends the new segment of every trail to the
+  //! buffer and releases the samples that left the trails.
+  void Stream(StreamBuffer& buffer);
+
+  //! Draws the trails in the viewport and adds the GL work to stats.
+  void Draw(const Viewport& viewport, const StreamBuffer& buffer, RenderStats& stats) const;
+
+  const ContrailStats& Stats() const { return stats_; }
+
+private:
+  size_t BlockBytes() const { return aircraft_ * 2 * sizeof(ContrailVertex); }
+
+  size_t             aircraft_;
+  int                length_;
+  GLuint             fade_texture_;
+
+  // Per aircraft: position at the last sample and current tail
+  std::vector<float> last_x_, last_y_, last_z_;
+  std::vector<float> tail_x_, tail_y_, tail_z_;
+
+  // Live samples: ring of buffer offsets of their blocks, oldest first
+  std::vector<size_t> sample_offset_;
+  int                first_;
+  int                count_;
+  int                serial_;          // Number of the newest sample
+
+  bool               sample_;          // This frame appends a sample
+  int                last_sample_ms_;
+
+  // Throughput window
+  int                window_start_ms_;
+  long long          window_vertices_;
+  int                now_ms_;
+
+  ContrailStats      stats_;
+};
+
+#endif // CONTRAILS_H
@@ -0,0 +1,423 @@
+//|___________________________________________________________________
+//!
+//! \file fleet.cpp
+//!
+//! \brief Fleet of autopiloted aircraft implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "fleet.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float  Fleet::SPEED           = 10.0f;
+const float  Fleet::TURN_RATE       = gmtl::Math::deg2Rad(45.0f);
+const float  Fleet::WAYPOINT_RADIUS = 10.0f;
+const int    Fleet::WAYPOINTS       = 8;
+const size_t Fleet::GRAIN           = 512;
+
+const float SLOT_SPACING = 25.0f;     // Distance between wingmen slots
+const float TWO_PI       = 6.2831853f;
+
+//|____________________________________________________________________
+//|
+//| Function: Rotate
+//|
+//! \param x,y,z,w     [in]  Unit quaternion.
+//! \param v           [in]  Vector.
+//! \param out         [out] v rotated by the quaternion.
+//! \return None.
+//|____________________________________________________________________
+
+static inline void Rotate(float x, float y, float z, float w, const float* v, float* out)
+{
+  // t = 2 * (q x v), out = v + w * t + q x t
+  float tx = 2 * (y * v[2] - z * v[1]);
+  float ty = 2 * (z * v[0] - x * v[2]);
+  float tz = 2 * (x * v[1] - y * v[0]);
+
+  out[0] = v[0] + w * tx + (y * tz - z * ty);
+  out[1] = v[1] + w * ty + (z * tx - x * tz);
+  out[2] = v[2] + w * tz + (x * ty - y * tx);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Random
+//|
+//! \param seed    [in] Any integer.
+//! \return Deterministic pseudo random number in [0,1].
+//|____________________________________________________________________
+
+static float Random(unsigned int seed)
+{
+  seed = (seed ^ 61u) ^ (seed >> 16);
+  seed *= 9u;
+  seed ^= seed >> 4;
+  seed *= 0x27d4eb2du;
+  seed ^= seed >> 15;
+  return (seed & 0xFFFFFF) / (float) 0xFFFFFF;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetState::Resize
+//|
+//! \param count   [in] Number of aircraft.
+//! \return None.
+//|____________________________________________________________________
+
+void FleetState::Resize(size_t count)
+{
+  px.resize(count); py.resize(count); pz.resize(count);
+  qx.resize(count); qy.resize(count); qz.resize(count); qw.resize(count);
+  waypoint.resize(count);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetState::operator==
+//|
+//! \param other   [in] State to compare with.
+//! \return True if all poses are bit-identical.
+//|____________________________________________________________________
+
+bool FleetState::operator==(const FleetState& other) const
+{
+  const std::vector<float>* a[7] = { &px, &py, &pz, &qx, &qy, &qz, &qw };
+  const std::vector<float>* b[7] = { &other.px, &other.py, &other.pz, &other.qx, &other.qy, &other.qz, &other.qw };
+
+  for (int k = 0; k < 7; ++k) {
+    if (a[k]->size() != b[k]->size()) return false;
+    if (!a[k]->empty() && memcmp(&(*a[k])[0], &(*b[k])[0], a[k]->size() * sizeof(float)) != 0) return false;
+  }
+
+  return waypoint == other.waypoint;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::Fleet
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+Fleet::Fleet()
+  : formation_size_(1)
+{
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::Init
+//|
+//! \param count           [in] Number of aircraft.
+//! \param formation_size  [in] Aircraft per formation (leader included).
+//! \param area            [in] Half size of the area of the formation loops.
+//! \return None.
+//|____________________________________________________________________
+
+void Fleet::Init(size_t count, int formation_size, float area)
+{
+  formation_size_ = std::max(1, formation_size);
+  size_t formations = (count + formation_size_ - 1) / formation_size_;
+
+  route_x_.resize(formations);
+  route_z_.resize(formations);
+  route_radius_.resize(formations);
+  route_height_.resize(formations);
+
+  for (size_t f = 0; f < formations; ++f) {
+    route_x_[f]      = (Random((unsigned int) f * 2)     * 2 - 1) * area;
+    route_z_[f]      = (Random((unsigned int) f * 2 + 1) * 2 - 1) * area;
+    route_radius_[f] = 60.0f + 10.0f * (f % 4);
+    route_height_[f] = 5.0f  +  4.0f * (f % 3);
+  }
+
+  leader_.resize(count);
+  slot_x_.resize(count);
+  slot_y_.resize(count);
+  slot_z_.resize(count);
+  cur_.Resize(count);
+  next_.Resize(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    size_t f    = i / formation_size_;
+    int    slot = (int) (i % formation_size_);
+
+    // V formation: wingmen alternate left/right, one row further back each pair
+    int   row  = (slot + 1) / 2;
+    float side = (slot % 2) ? 1.0f : -1.0f;
+
+    leader_[i] = slot ? (int) (f * formation_size_) : -1;
+    slot_x_[i] = side * SLOT_SPACING * row;
+    slot_y_[i] = 0.0f;
+    slot_z_[i] = -SLOT_SPACING * row;
+
+    // Start on the loop, heading for the next waypoint
+    int   k0 = (int) (f % WAYPOINTS);
+    float p0[3], p1[3];
+    Waypoint(f, k0, p0);
+    Waypoint(f, k0 + 1, p1);
+
+    float yaw = atan2f(p1[0] - p0[0], p1[2] - p0[2]);
+    float q[4] = { 0.0f, sinf(yaw / 2), 0.0f, cosf(yaw / 2) };
+    float slot_world[3];
+    float slot_local[3] = { slot_x_[i], slot_y_[i], slot_z_[i] };
+    Rotate(q[0], q[1], q[2], q[3], slot_local, slot_world);
+
+    cur_.px[i] = p0[0] + slot_world[0];
+    cur_.py[i] = p0[1] + slot_world[1];
+    cur_.pz[i] = p0[2] + slot_world[2];
+    cur_.qx[i] = q[0];
+    cur_.qy[i] = q[1];
+    cur_.qz[i] = q[2];
+    cur_.qw[i] = q[3];
+    cur_.waypoint[i] = (k0 + 1) % WAYPOINTS;
+  }
+
+  prev_ = cur_;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::Waypoint
+//|
+//! \param formation   [in]  Formation index.
+//! \param k           [in]  Waypoint index (wraps around).
+//! \param p           [out] Waypoint position.
+//! \return None.
+//|____________________________________________________________________
+
+void Fleet::Waypoint(size_t formation, int k, float* p) const
+{
+  float a = TWO_PI * (k % WAYPOINTS) / WAYPOINTS;
+
+  p[0] = route_x_[formation] + route_radius_[formation] * cosf(a);
+  p[1] = route_height_[formation] + 3.0f * sinf(3 * a);
+  p[2] = route_z_[formation] + route_radius_[formation] * sinf(a);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::Update
+//|
+//! \param jobs    [in] Job system, or null for a serial update.
+//! \param dt      [in] Tick length in secs.
+//! \return None.
+//|____________________________________________________________________
+
+void Fleet::Update(JobSystem* jobs, float dt)
+{
+  if (jobs) jobs->ParallelFor(Size(), GRAIN, [this, dt](size_t begin, size_t end) { UpdateRange(begin, end, dt); });
+  else      UpdateRange(0, Size(), dt);
+
+  std::swap(prev_, cur_);
+  std::swap(cur_, next_);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::UpdateRange
+//|
+//! \param begin,end   [in] Aircraft range.
+//! \param dt          [in] Tick length in secs.
+//! \return None.
+//!
+//! Autopilot: turns towards the target (waypoint for leaders, formation
+//! slot for wingmen) at up to TURN_RATE, then moves forward. Reads only
+//! cur_ and writes only the range in next_.
+//|____________________________________________________________________
+
+void Fleet::UpdateRange(size_t begin, size_t end, float dt)
+{
+  const float FORWARD[3] = { 0.0f, 0.0f, 1.0f };     // Plane flies along its local +Z
+
+  for (size_t i = begin; i < end; ++i) {
+    float x = cur_.qx[i], y = cur_.qy[i], z = cur_.qz[i], w = cur_.qw[i];
+    float pos[3] = { cur_.px[i], cur_.py[i], cur_.pz[i] };
+    float target[3];
+    int   waypoint = cur_.waypoint[i];
+    int   leader   = leader_[i];
+
+    if (leader < 0) {
+      Waypoint(i / formation_size_, waypoint, target);
+    } else {
+      float slot_local[3] = { slot_x_[i], slot_y_[i], slot_z_[i] };
+      float slot_world[3];
+      Rotate(cur_.qx[leader], cur_.qy[leader], cur_.qz[leader], cur_.qw[leader], slot_local, slot_world);
+
+      target[0] = cur_.px[leader] + slot_world[0];
+      target[1] = cur_.py[leader] + slot_world[1];
+      target[2] = cur_.pz[leader] + slot_world[2];
+    }
+
+    float d[3] = { target[0] - pos[0], target[1] - pos[1], target[2] - pos[2] };
+    float dist = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+    float f[3];
+    Rotate(x, y, z, w, FORWARD, f);
+
+    // Turn towards the target
+    if (dist > 1e-4f) {
+      d[0] /= dist; d[1] /= dist; d[2] /= dist;
+
+      float c     = std::max(-1.0f, std::min(f[0]*d[0] + f[1]*d[1] + f[2]*d[2], 1.0f));
+      float angle = std::min(acosf(c), TURN_RATE * dt);
+      float axis[3] = { f[1]*d[2] - f[2]*d[1], f[2]*d[0] - f[0]*d[2], f[0]*d[1] - f[1]*d[0] };
+      float len = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+
+      if (len < 1e-6f) { axis[0] = 0.0f; axis[1] = 1.0f; axis[2] = 0.0f; len = 1.0f; }   // Target straight behind
+
+      if (angle > 0.0f) {
+        float s  = sinf(angle / 2) / len;
+        float rx = axis[0] * s, ry = axis[1] * s, rz = axis[2] * s, rw = cosf(angle / 2);
+
+        // q = r * q (rotation about a world axis)
+        float nx = rw*x + rx*w + ry*z - rz*y;
+        float ny = rw*y - rx*z + ry*w + rz*x;
+        float nz = rw*z + rx*y - ry*x + rz*w;
+        float nw = rw*w - rx*x - ry*y - rz*z;
+        float n  = 1.0f / sqrtf(nx*nx + ny*ny + nz*nz + nw*nw);
+
+        x = nx * n; y = ny * n; z = nz * n; w = nw * n;
+        Rotate(x, y, z, w, FORWARD, f);
+      }
+    }
+
+    // Leaders fly at SPEED, wingmen speed up or slow down to reach their slot
+    float speed = SPEED;
+    if (leader < 0) {
+      if (dist < WAYPOINT_RADIUS) waypoint = (waypoint + 1) % WAYPOINTS;
+    } else {
+      float ahead = (d[0]*f[0] + d[1]*f[1] + d[2]*f[2]) * dist;
+      speed = SPEED * std::max(0.5f, std::min(1.0f + ahead / SLOT_SPACING, 1.5f));
+    }
+
+    next_.px[i] = pos[0] + f[0] * speed * dt;
+    next_.py[i] = pos[1] + f[1] * speed * dt;
+    next_.pz[i] = pos[2] + f[2] * speed * dt;
+    next_.qx[i] = x;
+    next_.qy[i] = y;
+    next_.qz[i] = z;
+    next_.qw[i] = w;
+    next_.waypoint[i] = waypoint;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Fleet::Pose
+//|
+//! \param i       [in] Aircraft index.
+//! \param alpha   [in] 0 = previous tick, 1 = current tick.
+//! \return Pose of the aircraft (rotation + translation).
+//|____________________________________________________________________
+
+gmtl::Matrix44f Fleet::Pose(size_t i, float alpha) const
+{
+  gmtl::Quatf q0(prev_.qx[i], prev_.qy[i], prev_.qz[i], prev_.qw[i]);
+  gmtl::Quatf q1(cur_.qx[i],  cur_.qy[i],  cur_.qz[i],  cur_.qw[i]);
+  gmtl::Quatf q;
+  gmtl::slerp(q, alpha, q0, q1);
+
+  gmtl::Vec3f p(prev_.px[i] + (cur_.px[i] - prev_.px[i]) * alpha,
+                prev_.py[i] + (cur_.py[i] - prev_.py[i]) * alpha,
+                prev_.pz[i] + (cur_.pz[i] - prev_.pz[i]) * alpha);
+
+  gmtl::Matrix44f pose;
+  gmtl::setRot(pose, q);
+  gmtl::setTrans(pose, p);
+  pose.setState(gmtl::Matrix44f::AFFINE);
+
+  return pose;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RunFleetBenchmark
+//|
+//! \param max_threads     [in] Largest thread count, 0 for all hardware threads.
+//! \return 0 if serial and parallel runs are bit-identical, 1 otherwise.
+//|____________________________________________________________________
+
+int RunFleetBenchmark(int max_threads)
+{
+  using namespace std::chrono;
+
+  const float  DT               = 0.05f;
+  const int    FORMATION_SIZE   = 5;
+  const size_t SIZES[]          = { 1000, 10000, 100000, 1000000 };
+  const size_t WORK_PER_SIZE    = 20000000;      // Aircraft updates timed per (size, threads)
+
+  if (max_threads <= 0) max_threads = (int) std::thread::hardware_concurrency();
+  if (max_threads <= 0) max_threads = 1;
+
+  std::vector<int> thread_counts;
+  for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  printf("Fleet autopilot update, %d hardware threads\n", (int) std::thread::hardware_concurrency());
+  printf("%10s %8s %12s %14s %8s %10s\n", "aircraft", "threads", "ms/tick", "Maircraft/s", "speedup", "steals");
+
+  for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); ++s) {
+    size_t count = SIZES[s];
+    int    ticks = (int) std::max<size_t>(10, WORK_PER_SIZE / count);
+    float  area  = 50.0f * sqrtf((float) count);
+    double base_ms = 0.0;
+
+    for (size_t t = 0; t < thread_counts.size(); ++t) {
+      JobSystem jobs(thread_counts[t]);
+      Fleet     fleet;
+      fleet.Init(count, FORMATION_SIZE, area);
+      fleet.Update(&jobs, DT);                   // Warm up
+
+      long long steals = jobs.Steals();
+      steady_clock::time_point start = steady_clock::now();
+
+      for (int k = 0; k < ticks; ++k) fleet.Update(&jobs, DT);
+
+      double ms = duration<double, std::milli>(steady_clock::now() - start).count() / ticks;
+      if (t == 0) base_ms = ms;
+
+      printf("%10u %8d %12.3f %14.1f %8.2f %10lld\n", (unsigned int) count, thread_counts[t], ms,
+             count / ms / 1000.0, base_ms / ms, (jobs.Steals() - steals) / ticks);
+    }
+  }
+
+  // Determinism: serial and parallel runs must give bit-identical poses
+  const size_t CHECK_COUNT = 100000;
+  const int    CHECK_TICKS = 200;
+
+  JobSystem jobs(max_threads);
+  Fleet     serial, parallel;
+  serial.Init(CHECK_COUNT, FORMATION_SIZE, 50.0f * sqrtf((float) CHECK_COUNT));
+  parallel.Init(CHECK_COUNT, FORMATION_SIZE, 50.0f * sqrtf((float) CHECK_COUNT));
+
+  bool identical = true;
+  for (int k = 0; k < CHECK_TICKS && identical; ++k) {
+    serial.Update(0, DT);
+    parallel.Update(&jobs, DT);
+    identical = serial.State() == parallel.State();
+  }
+
+  printf("Determinism check (%u aircraft, %d ticks, serial vs %d threads): %s\n",
+         (unsigned int) CHECK_COUNT, CHECK_TICKS, jobs.Threads(), identical ? "PASS" : "FAIL");
+
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+//|___________________________________________________________________
+//!
+//! \file fleet.h
+//!
+//! \brief Fleet of autopiloted aircraft.
+//!
+//! Poses are kept as structure of arrays (one array per component). Each
+//! tick reads the current state and writes the next one, so every
+//! aircraft only depends on last tick's poses: the update can be split
+//! into chunks over any number of threads and still produce exactly the
+//! same result as a serial run.
+//!
+//! Aircraft fly in formations: the leader follows a loop of waypoints,
+//! the wingmen keep their slot relative to the leader.
+//|___________________________________________________________________
+
+#ifndef FLEET_H
+#define FLEET_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <gmtl/gmtl.h>
+
+#include "job_system.h"
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+// Per-tick state, structure of arrays
+struct FleetState
+{
+  std::vector<float> px, py, pz;          // Position
+  std::vector<float> qx, qy, qz, qw;      // Orientation (unit quaternion)
+  std::vector<int>   waypoint;            // Next waypoint (leaders only)
+
+  void Resize(size_t count);
+  bool operator==(const FleetState& other) const;   // Bit-wise comparison
+};
+
+//|____________________________________________________________________
+//|
+//| Class: Fleet
+//|____________________________________________________________________
+
+class Fleet
+{
+public:
+  static const float  SPEED;              // Leader speed, units per sec
+  static const float  TURN_RATE;          // Rads per sec
+  static const float  WAYPOINT_RADIUS;    // Waypoint is reached within this distance
+  static const int    WAYPOINTS;          // Waypoints per formation loop
+  static const size_t GRAIN;              // Aircraft per chunk
+
+  Fleet();
+
+  //! Places count aircraft in formations of formation_size. Formation
+  //! loops are centered at random in [-area, area] on x and z.
+  void Init(size_t count, int formation_size, float area);
+
+  //! Advances all aircraft by dt secs, in parallel over jobs or serially
+  //! when jobs is null.
+  void Update(JobSystem* jobs, float dt);
+
+  size_t Size() const { return leader_.size(); }
+
+  //! Pose of aircraft i, alpha in [0,1] between the previous and the
+  //! current tick.
+  gmtl::Matrix44f Pose(size_t i, float alpha) const;
+
+  const FleetState& State() const { return cur_; }
+
+private:
+  void UpdateRange(size_t begin, size_t end, float dt);
+  void Waypoint(size_t formation, int k, float* p) const;
+
+  FleetState         prev_, cur_, next_;
+
+  // Static per-aircraft data
+  std::vector<int>   leader_;             // Index of the leader, -1 for leaders
+  std::vector<float> slot_x_, slot_y_, slot_z_;   // Slot in the leader's frame
+  int                formation_size_;
+
+  // Per-formation waypoint loop
+  std::vector<float> route_x_, route_z_, route_radius_, route_height_;
+};
+
+//! Prints update times of 1k to 1M aircraft on 1 to max_threads threads,
+//! then checks that serial and parallel runs give bit-identical poses.
+//! Returns 0 if the check passes.
+int RunFleetBenchmark(int max_threads);
+
+#endif // FLEET_H
@@ -0,0 +1,204 @@
+//|___________________________________________________________________
+//!
+//! \file job_system.cpp
+//!
+//! \brief Work-stealing job system implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include "job_system.h"
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::JobSystem
+//|
+//! \param threads     [in] Thread count including the calling thread,
+//!                         0 for all hardware threads.
+//! \return None.
+//|____________________________________________________________________
+
+JobSystem::JobSystem(int threads)
+  : active_(0), quit_(false), steals_(0)
+{
+  if (threads <= 0) threads = (int) std::thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+
+  for (int i = 0; i < threads; ++i) queues_.push_back(new WorkQueue);
+  for (int i = 1; i < threads; ++i) workers_.push_back(std::thread(&JobSystem::Worker, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cond_.notify_all();
+
+  for (size_t i = 0; i < workers_.size(); ++i) workers_[i].join();
+  for (size_t i = 0; i < queues_.size(); ++i)  delete queues_[i];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Run
+//|
+//! \param count   [in] Number of indices.
+//! \param grain   [in] Largest sub-range handed to fn.
+//! \param fn      [in] Range function.
+//! \param ctx     [in] Passed to fn.
+//! \return None.
+//!
+//! Must be called from the thread that created the job system.
+//|____________________________________________________________________
+
+void JobSystem::Run(size_t count, size_t grain, TaskFunc fn, void* ctx)
+{
+  if (count == 0) return;
+
+  // A single chunk runs on the calling thread, without waking the workers
+  if (count <= grain) {
+    fn(ctx, 0, count);
+    return;
+  }
+
+  Task task;
+  task.fn    = fn;
+  task.ctx   = ctx;
+  task.grain = grain ? grain : 1;
+  task.remaining.store(count);
+
+  {
+    std::lock_guard<std::mutex> lock(queues_[0]->mutex);
+    Job job = { &task, 0, count };
+    queues_[0]->jobs.push_back(job);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++active_;
+  }
+  cond_.notify_all();
+
+  while (task.remaining.load(std::memory_order_acquire) > 0) {
+    Job job;
+    if (Pop(0, job) || Steal(0, job)) Execute(0, job);
+    else                              std::this_thread::yield();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --active_;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Pop / Steal
+//|
+//! \param self    [in]  Index of the calling thread's queue.
+//! \param job     [out] Job taken.
+//! \return True if a job was taken.
+//!
+//! Pop takes the newest (smallest) job of the own queue; Steal takes the
+//! oldest (largest) job of another queue.
+//|____________________________________________________________________
+
+bool JobSystem::Pop(int self, Job& job)
+{
+  WorkQueue& q = *queues_[self];
+  std::lock_guard<std::mutex> lock(q.mutex);
+
+  if (q.jobs.empty()) return false;
+
+  job = q.jobs.back();
+  q.jobs.pop_back();
+  return true;
+}
+
+bool JobSystem::Steal(int self, Job& job)
+{
+  int n = (int) queues_.size();
+
+  for (int i = 1; i < n; ++i) {
+    WorkQueue& q = *queues_[(self + i) % n];
+    std::lock_guard<std::mutex> lock(q.mutex);
+
+    if (!q.jobs.empty()) {
+      job = q.jobs.front();
+      q.jobs.pop_front();
+      ++steals_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Execute
+//|
+//! \param self    [in] Index of the calling thread's queue.
+//! \param job     [in] Job to run.
+//! \return None.
+//!
+//! Splits the job down to the grain size, leaving the right halves on the
+//! own queue for this thread or thieves, then runs the remaining range.
+//|____________________________________________________________________
+
+void JobSystem::Execute(int self, Job job)
+{
+  Task* task = job.task;
+
+  while (job.end - job.begin > task->grain) {
+    size_t mid   = job.begin + (job.end - job.begin) / 2;
+    Job    right = { task, mid, job.end };
+
+    {
+      std::lock_guard<std::mutex> lock(queues_[self]->mutex);
+      queues_[self]->jobs.push_back(right);
+    }
+
+    job.end = mid;
+  }
+
+  task->fn(task->ctx, job.begin, job.end);
+
+  // Last access to the task: it may be gone once remaining reaches 0
+  task->remaining.fetch_sub(job.end - job.begin, std::memory_order_acq_rel);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Worker
+//|
+//! \param self    [in] Index of the worker's queue.
+//! \return None.
+//!
+//! Runs and steals jobs while a ParallelFor is in progress, sleeps
+//! otherwise.
+//|____________________________________________________________________
+
+void JobSystem::Worker(int self)
+{
+  for (;;) {
+    Job job;
+    if (Pop(self, job) || Steal(self, job)) {
+      Execute(self, job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (quit_) return;
+
+    if (active_ == 0) {
+      while (!quit_ && active_ == 0) cond_.wait(lock);
+    } else {
+      lock.unlock();
+      std::this_thread::yield();
+    }
+  }
+}
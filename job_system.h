@@ -0,0 +1,101 @@
+//|___________________________________________________________________
+//!
+//! \file job_system.h
+//!
+//! \brief Work-stealing job system.
+//!
+//! ParallelFor() puts the whole index range as one job on the calling
+//! thread's queue. Whoever runs a job larger than the grain size splits
+//! it in half, keeps the left half and pushes the right half on its own
+//! queue. Idle workers steal from the other end of other queues, so big
+//! halves get stolen first and the load spreads over all threads. The
+//! calling thread takes part until the whole range is done. A range that
+//! fits in one grain runs on the calling thread alone.
+//|___________________________________________________________________
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//|____________________________________________________________________
+//|
+//| Class: JobSystem
+//|____________________________________________________________________
+
+class JobSystem
+{
+public:
+  //! threads counts the calling thread; 0 uses all hardware threads.
+  explicit JobSystem(int threads = 0);
+  ~JobSystem();
+
+  int Threads() const { return (int) queues_.size(); }
+
+  //! Calls fn(begin, end) over disjoint sub-ranges covering [0, count),
+  //! each at most grain long, and returns once all of them are done.
+  template <typename FUNC>
+  void ParallelFor(size_t count, size_t grain, const FUNC& fn)
+  {
+    Run(count, grain, &Invoke<FUNC>, (void*) &fn);
+  }
+
+  long long Steals() const { return steals_; }
+
+private:
+  typedef void (*TaskFunc)(void* ctx, size_t begin, size_t end);
+
+  struct Task
+  {
+    TaskFunc            fn;
+    void*               ctx;
+    size_t              grain;
+    std::atomic<size_t> remaining;      // Indices not processed yet
+  };
+
+  struct Job
+  {
+    Task*  task;
+    size_t begin, end;
+  };
+
+  // Owner pushes/pops at the back, thieves take from the front
+  struct WorkQueue
+  {
+    std::mutex      mutex;
+    std::deque<Job> jobs;
+  };
+
+  template <typename FUNC>
+  static void Invoke(void* ctx, size_t begin, size_t end) { (*(const FUNC*) ctx)(begin, end); }
+
+  void Run(size_t count, size_t grain, TaskFunc fn, void* ctx);
+  bool Pop(int self, Job& job);
+  bool Steal(int self, Job& job);
+  void Execute(int self, Job job);
+  void Worker(int self);
+
+  std::vector<WorkQueue*>  queues_;     // One per thread, 0 = calling thread
+  std::vector<std::thread> workers_;
+
+  std::mutex               mutex_;
+  std::condition_variable  cond_;
+  int                      active_;     // ParallelFor calls in progress
+  bool                     quit_;
+
+  std::atomic<long long>   steals_;
+};
+
+#endif // JOB_SYSTEM_H
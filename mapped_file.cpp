@@ -0,0 +1,210 @@
+//|___________________________________________________________________
+//!
+//! \file mapped_file.cpp
+//!
+//! \brief Read-only memory-mapped file implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//|____________________________________________________________________
+//|
+//| Function: Granularity
+//|
+//! \param None.
+//! \return Alignment of view offsets (64 KB on Windows, a page elsewhere).
+//|____________________________________________________________________
+
+static unsigned long long Granularity()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+#else
+  return (unsigned long long) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedFile::MappedFile
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+#ifdef _WIN32
+MappedFile::MappedFile() : size_(0), file_(INVALID_HANDLE_VALUE), mapping_(0) {}
+#else
+MappedFile::MappedFile() : size_(0), fd_(-1) {}
+#endif
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedFile::Open
+//|
+//! \param path    [in] File to map.
+//! \return True on success.
+//|____________________________________________________________________
+
+bool MappedFile::Open(const char* path)
+{
+  Close();
+
+#ifdef _WIN32
+  file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+  if (file_ == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) { Close(); return false; }
+
+  // Only a mapping object, views are created by MappedView
+  mapping_ = CreateFileMappingA(file_, 0, PAGE_READONLY, 0, 0, 0);
+  if (!mapping_) { Close(); return false; }
+
+  size_ = (unsigned long long) size.QuadPart;
+#else
+  fd_ = open(path, O_RDONLY);
+  if (fd_ < 0) return false;
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size == 0) { Close(); return false; }
+
+  size_ = (unsigned long long) st.st_size;
+#endif
+
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedFile::Close
+//|
+//! \param None.
+//! \return None.
+//!
+//! Views of the file must be unmapped first.
+//|____________________________________________________________________
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+  if (mapping_)                      CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+  mapping_ = 0;
+  file_    = INVALID_HANDLE_VALUE;
+#else
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+#endif
+
+  size_ = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedFile::IsOpen
+//|
+//! \param None.
+//! \return True if a file is open.
+//|____________________________________________________________________
+
+bool MappedFile::IsOpen() const
+{
+#ifdef _WIN32
+  return mapping_ != 0;
+#else
+  return fd_ >= 0;
+#endif
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedView::MappedView
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+MappedView::MappedView() : base_(0), length_(0), data_(0) {}
+
+MappedView::~MappedView()
+{
+  Unmap();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedView::Map
+//|
+//! \param file    [in] Open file.
+//! \param offset  [in] First byte to map.
+//! \param bytes   [in] Number of bytes to map.
+//! \return True on success.
+//|____________________________________________________________________
+
+bool MappedView::Map(const MappedFile& file, unsigned long long offset, size_t bytes)
+{
+  Unmap();
+
+  if (!file.IsOpen() || bytes == 0 || offset > file.size_ || bytes > file.size_ - offset) return false;
+
+  unsigned long long start = offset - offset % Granularity();
+  size_t             skip  = (size_t) (offset - start);
+
+#ifdef _WIN32
+  base_ = MapViewOfFile(file.mapping_, FILE_MAP_READ, (DWORD) (start >> 32), (DWORD) start, skip + bytes);
+  if (!base_) return false;
+#else
+  base_ = mmap(0, skip + bytes, PROT_READ, MAP_SHARED, file.fd_, (off_t) start);
+  if (base_ == MAP_FAILED) { base_ = 0; return false; }
+#endif
+
+  length_ = skip + bytes;
+  data_   = (const unsigned char*) base_ + skip;
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MappedView::Unmap
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+void MappedView::Unmap()
+{
+  if (base_) {
+#ifdef _WIN32
+    UnmapViewOfFile(base_);
+#else
+    munmap(base_, length_);
+#endif
+  }
+
+  base_   = 0;
+  length_ = 0;
+  data_   = 0;
+}
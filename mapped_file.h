@@ -0,0 +1,87 @@
+//|___________________________________________________________________
+//!
+//! \file mapped_file.h
+//!
+//! \brief Read-only memory-mapped file (Win32 file mapping or POSIX mmap).
+//|___________________________________________________________________
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stddef.h>
+
+//|____________________________________________________________________
+//|
+//| Class: MappedFile
+//|
+//! Opens a file for mapping. The file itself is never mapped as a whole,
+//! so it can be larger than the address space (2 GB on Win32): readers
+//! map the parts they need with MappedView. Pages are brought in by the
+//! OS on first access, so only the parts that are actually read use
+//! physical memory.
+//|____________________________________________________________________
+
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  bool Open(const char* path);     // Returns false if the file can't be mapped
+  void Close();
+
+  bool               IsOpen() const;
+  unsigned long long Size() const { return size_; }
+
+private:
+  friend class MappedView;
+
+  MappedFile(const MappedFile&);             // Not copyable
+  MappedFile& operator=(const MappedFile&);
+
+  unsigned long long size_;
+
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#else
+  int   fd_;
+#endif
+};
+
+//|____________________________________________________________________
+//|
+//| Class: MappedView
+//|
+//! Maps a range of a MappedFile. The range can start anywhere: the view
+//! itself starts at the allocation granularity boundary below it.
+//|____________________________________________________________________
+
+class MappedView
+{
+public:
+  MappedView();
+  ~MappedView();
+
+  //! Maps bytes of file from offset on. Returns false if the range is
+  //! outside the file or can't be mapped.
+  bool Map(const MappedFile& file, unsigned long long offset, size_t bytes);
+  void Unmap();
+
+  const unsigned char* Data() const { return data_; }   // Byte at offset
+
+private:
+  MappedView(const MappedView&);             // Not copyable
+  MappedView& operator=(const MappedView&);
+
+  void*                base_;                // Start of the view, aligned
+  size_t               length_;
+  const unsigned char* data_;
+};
+
+#endif // MAPPED_FILE_H
@@ -19,6 +19,15 @@
 //!   f,h = pitches the camera fh 
 //!   v,n = yaws the camera vn ƫ
 //!
+//!   m   = toggles the state-sorted render queue (draw stats in the title bar)
+//!   j   = toggles a slow plane pose source (dead-reckoning between updates)
+//!   [,] = halves/doubles the contrail length
+//!
+//! Command line:
+//!   --fleet-bench [threads] = benchmarks the fleet autopilot update on 1 to
+//!                             threads threads and checks that parallel and
+//!                             serial updates give bit-identical poses
+//!
 //! TODO: Extend the code to satisfy the requirements given in the assignment handout
 //!
 //! Note: Good programmer uses good comments! :)
@@ -30,11 +39,26 @@
 //|___________________
 
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #include <gmtl/gmtl.h>
 
 #include <GL/glut.h>
 
+#include "render_queue.h"
+#include "pose_interpolator.h"
+#include "terrain.h"
+#include "job_system.h"
+#include "fleet.h"
+#include "stream_buffer.h"
+#include "contrails.h"
+
 //|___________________
 //|
 //| Constants
@@ -48,6 +72,25 @@ const float P_HEIGHT = 1.5;
 // Camera's view frustum 
 const float CAM_FOV  = 60.0f;     // Field of view in degs
 
+// Simulation tick periods of the plane pose source
+const int SIM_TICK_MS      = 50;  // Normal rate (20 Hz)
+const int SLOW_SIM_TICK_MS = 200; // Slow rate (5 Hz), toggled with j
+
+// Terrain heightmap, generated on first run if missing
+const char*        TERRAIN_FILE   = "terrain.hmap";
+const unsigned int TERRAIN_SIZE   = 4097;         // Samples per side, 64 * 2^6 + 1 (32 MB file)
+const float        TERRAIN_CELL   = 1.0f;         // World units between samples
+const float        TERRAIN_HEIGHT = 15.0f;        // Height range
+const float        TERRAIN_BASE   = -20.0f;       // Height of the lowest point
+const size_t       TERRAIN_BUDGET = 16 << 20;     // Memory budget of the resident tiles (16 MB)
+
+// Autopiloted fleet flying around the plane
+const int FLEET_SIZE      = 20;
+const int FLEET_FORMATION = 5;    // Aircraft per formation, leader included
+
+// Contrail length in samples (Contrails::SAMPLE_MS apart), changed with [ and ]
+const int CONTRAIL_LENGTH = 40;
+
 //|___________________
 //|
 //| Global Variables
@@ -81,6 +124,30 @@ gmtl::Matrix44f xrotn_mat;
 gmtl::Matrix44f yrotp_mat;
 gmtl::Matrix44f yrotn_mat;
 
+// Render queue and the static meshes it draws
+RenderQueue render_queue;
+int  plane_mesh       = -1;
+int  world_frame_mesh = -1;
+int  local_frame_mesh = -1;
+bool render_sorted    = true;   // Toggled with m, draws in scene order when false
+RenderStats frame_stats;        // Render queue counters plus the draws done outside the queue
+
+// Plane pose as displayed: interpolated/extrapolated from the simulation ticks of plane_pose
+PoseInterpolator plane_interp(SIM_TICK_MS / 1000.0f);
+int sim_tick_ms = SIM_TICK_MS;
+
+// Streaming ground under the plane
+Terrain terrain;
+
+// Autopiloted fleet, updated in parallel every simulation tick
+std::unique_ptr<JobSystem> jobs;  // Created by InitFleet, null when the fleet fits in one chunk
+Fleet                      fleet;
+int                        last_tick_ms = 0;   // Time of the last simulation tick
+
+// Contrails behind the plane (index 0) and the fleet (1..), streamed every frame
+StreamBuffer stream_buffer;       // Created by InitGL
+Contrails    contrails;
+
 
 //|___________________
 //|
@@ -88,12 +155,18 @@ gmtl::Matrix44f yrotn_mat;
 //|___________________
 
 void InitMatrices();
+void InitMeshes();
+void InitTerrain();
+void InitFleet();
 void InitGL(void);
 void DisplayFunc(void);
 void KeyboardFunc(unsigned char key, int x, int y);
 void ReshapeFunc(int w, int h);
-void DrawCoordinateFrame(const float l);
-void DrawPlane(const float width, const float length, const float height);
+void ShowRenderStats();
+void IdleFunc(void);
+void SimTimerFunc(int value);
+void BuildCoordinateFrame(Mesh& mesh, const float l);
+void BuildPlane(Mesh& mesh, const float width, const float length, const float height);
 
 //|____________________________________________________________________
 //|
@@ -191,6 +264,76 @@ void InitMatrices()
     fixed_cam_pose = fixed_transform_mat * fixed_rotate_mat;
     gmtl::invert(fixed_view_mat, fixed_cam_pose);                 // View transform is the inverse of the camera pose
 }
+//|____________________________________________________________________
+//|
+//| Function: InitMeshes
+//|
+//! \param None.
+//! \return None.
+//!
+//! Records the static geometry and registers it with the render queue
+//|____________________________________________________________________
+
+void InitMeshes()
+{
+  Mesh plane, world_frame, local_frame;
+
+  BuildPlane(plane, P_WIDTH, P_LENGTH, P_HEIGHT);
+  BuildCoordinateFrame(world_frame, 100);
+  BuildCoordinateFrame(local_frame, 3);
+
+  plane_mesh       = render_queue.AddMesh(plane);
+  world_frame_mesh = render_queue.AddMesh(world_frame);
+  local_frame_mesh = render_queue.AddMesh(local_frame);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InitTerrain
+//|
+//! \param None.
+//! \return None.
+//!
+//! Opens the terrain heightmap, creating it first if it doesn't exist.
+//! Without it, the plane simply flies over the grey background.
+//|____________________________________________________________________
+
+void InitTerrain()
+{
+  if (terrain.Open(TERRAIN_FILE, TERRAIN_BASE, TERRAIN_BUDGET)) return;
+
+  printf("Generating terrain heightmap %s (%ux%u)...\n", TERRAIN_FILE, TERRAIN_SIZE, TERRAIN_SIZE);
+
+  if (!Terrain::CreateHeightmap(TERRAIN_FILE, TERRAIN_SIZE, TERRAIN_CELL, TERRAIN_HEIGHT) ||
+      !terrain.Open(TERRAIN_FILE, TERRAIN_BASE, TERRAIN_BUDGET)) {
+    printf("Couldn't create terrain heightmap %s, terrain disabled\n", TERRAIN_FILE);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InitFleet
+//|
+//! \param None.
+//! \return None.
+//!
+//! Places the fleet in formation loops around the origin, starts a job
+//! system with one thread per chunk of aircraft (up to the number of
+//! cores) and sets up the contrails of all aircraft.
+//|____________________________________________________________________
+
+void InitFleet()
+{
+  fleet.Init(FLEET_SIZE, FLEET_FORMATION, 0.0f);
+
+  // A single chunk is updated serially, no workers to wake every tick
+  size_t chunks = (fleet.Size() + Fleet::GRAIN - 1) / Fleet::GRAIN;
+  if (chunks > 1)
+    jobs.reset(new JobSystem((int) std::min<size_t>(chunks, std::thread::hardware_concurrency())));
+
+  contrails.Init(fleet.Size() + 1, CONTRAIL_LENGTH);
+}
+
 //|____________________________________________________________________
 //|
 //| Function: InitGL
@@ -206,6 +349,10 @@ void InitGL(void)
   glClearColor(0.7f, 0.7f, 0.7f, 1.0f); 
   glEnable(GL_DEPTH_TEST); 
   glShadeModel(GL_SMOOTH);
+
+  // Ring holding the longest contrails
+  stream_buffer.Init(contrails.RingBytes());
+  contrails.InitGL();
 }
 
 //|____________________________________________________________________
@@ -220,90 +367,85 @@ void InitGL(void)
 
 void DisplayFunc(void)
 {
-  // Modelview matrix
-  gmtl::Matrix44f modelview_mat;        // M, as defined in the handout
+  // Pose of the world coordinate frame
+  gmtl::Matrix44f world_mat;                      // IDENTITY
 
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  int now_ms = glutGet(GLUT_ELAPSED_TIME);
 
-//|____________________________________________________________________
-//|
-//| Viewport 1 rendering: shows the moving camera's view
-//|____________________________________________________________________
+  // Plane pose at display time, in between (or ahead of) the simulation ticks
+  gmtl::Matrix44f render_plane_pose = plane_interp.Evaluate(now_ms / 1000.0);
 
-  glViewport(0, 0, (GLsizei) w_width/2, (GLsizei) w_height);
+  // Fleet poses are interpolated between the last two ticks
+  float fleet_alpha = (float) (now_ms - last_tick_ms) / sim_tick_ms;
+  if (fleet_alpha > 1.0f) fleet_alpha = 1.0f;
 
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(CAM_FOV, (float)w_width/(2*w_height), 0.1f, 100.0f);     // Check MSDN: google "gluPerspective msdn"
+  std::vector<gmtl::Matrix44f> fleet_poses(fleet.Size());
+  for (size_t i = 0; i < fleet.Size(); ++i)
+    fleet_poses[i] = fleet.Pose(i, fleet_alpha);
 
-  // Approach1
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();                          // A good practice for beginner
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // Draws world coordinate frame
-  modelview_mat = view_mat;                  // M = C^-1
-  glLoadMatrixf(modelview_mat.mData);
-  DrawCoordinateFrame(100);
+  render_queue.BeginFrame();
+  terrain.BeginFrame();
 
-  // Draws plane and its local frame
-  modelview_mat *= plane_pose;               // M = C^-1 * T
-  glLoadMatrixf(modelview_mat.mData);
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
-  DrawCoordinateFrame(3);
+  // Appends a new contrail segment per aircraft on sample frames, the older ones stay in the ring
+  stream_buffer.BeginFrame();
+  contrails.BeginFrame(now_ms);
+  contrails.Record(0, render_plane_pose);
+  for (size_t i = 0; i < fleet_poses.size(); ++i)
+    contrails.Record(i + 1, fleet_poses[i]);
+  contrails.Stream(stream_buffer);
 
-/*
-  // Approach 2 (gives the same results as the approach 1)
-  glMatrixMode(GL_MODELVIEW);
+//|____________________________________________________________________
+//|
+//| Viewport 1 rendering: shows the moving camera's view
+//|____________________________________________________________________
 
-  // Draws world coordinate frame
-  glLoadMatrixf(view_mat.mData);             // M = C^-1
-  DrawCoordinateFrame(10);
+  Viewport cam_vp = { 0, 0, (GLsizei) w_width/2, (GLsizei) w_height,
+                      CAM_FOV, (float)w_width/(2*w_height), 0.1f, 100.0f, view_mat };   // M = C^-1 * ...
+  int vp1 = render_queue.AddViewport(cam_vp);
 
-  // Draws plane and its local frame
-  glMultMatrixf(plane_pose.mData);           // M = C^-1 * T (OpenGL calls build transforms in left-to-right order)
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
-  DrawCoordinateFrame(3);
-*/
+  render_queue.Submit(vp1, world_frame_mesh, world_mat);      // World coordinate frame
+  render_queue.Submit(vp1, plane_mesh,       render_plane_pose);     // Plane, M = C^-1 * T
+  render_queue.Submit(vp1, local_frame_mesh, render_plane_pose);     // Plane's local frame
+
+  for (size_t i = 0; i < fleet_poses.size(); ++i)
+    render_queue.Submit(vp1, plane_mesh, fleet_poses[i]);
 
 //|____________________________________________________________________
 //|
-//| TODO: Viewport 2 rendering: shows the fixed top-down view
+//| Viewport 2 rendering: shows the fixed top-down view
 //|____________________________________________________________________
 
-  // glViewport...
-
-  glViewport(w_width / 2, 0, (GLsizei)w_width / 2, (GLsizei)w_height);
-  
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(CAM_FOV, (float)w_width/(2*w_height), 0.1f, 100.0f);
+  Viewport fixed_vp = { (GLint) w_width/2, 0, (GLsizei) w_width/2, (GLsizei) w_height,
+                        CAM_FOV, (float)w_width/(2*w_height), 0.1f, 100.0f, fixed_view_mat };   // M = F^-1 * ...
+  int vp2 = render_queue.AddViewport(fixed_vp);
 
-  // glMatrixMode(GL_MODELVIEW);
-  // glLoadIdentity(); 
-  // ...
+  render_queue.Submit(vp2, world_frame_mesh, world_mat);      // World coordinate frame
+  render_queue.Submit(vp2, plane_mesh,       render_plane_pose);     // Plane, M = F^-1 * T
+  render_queue.Submit(vp2, local_frame_mesh, render_plane_pose);     // Plane's local frame
+  render_queue.Submit(vp2, local_frame_mesh, cam_pose);       // Movable camera (its local frame), M = F^-1 * C
 
-  // Approach2
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();                               // A good practice for beginner
+  for (size_t i = 0; i < fleet_poses.size(); ++i)
+    render_queue.Submit(vp2, plane_mesh, fleet_poses[i]);
 
-  //Draw world coordinate frame
-  modelview_mat = fixed_view_mat;                 // M = F^-1
-  glLoadMatrixf(modelview_mat.mData);
-  DrawCoordinateFrame(100);
+  // Sorts the items by (viewport, pipeline state, mesh, depth) and draws them
+  render_queue.Flush(render_sorted);
+  frame_stats = render_queue.Stats();
 
-  // Draws plane and its local frame
-  modelview_mat *= plane_pose;                    // M = F^-1 * T
-  glLoadMatrixf(modelview_mat.mData);
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
-  DrawCoordinateFrame(3);
+  // Terrain tiles, LOD chosen by distance from each viewport's camera
+  terrain.Draw(cam_vp, frame_stats);
+  terrain.Draw(fixed_vp, frame_stats);
+  terrain.EndFrame();
 
-  // Draws movable camera (its local frame)
-  modelview_mat = fixed_view_mat * cam_pose;      // M = F^-1 * C
-  glLoadMatrixf(modelview_mat.mData);
-  DrawCoordinateFrame(3);
+  // Contrails last: translucent, drawn from the stream buffer
+  contrails.Draw(cam_vp, stream_buffer, frame_stats);
+  contrails.Draw(fixed_vp, stream_buffer, frame_stats);
+  stream_buffer.EndFrame();
 
+  glutSwapBuffers();
 
-  glFlush();
+  ShowRenderStats();
 }
 
 //|____________________________________________________________________
@@ -397,6 +539,26 @@ void KeyboardFunc(unsigned char key, int x, int y)
       break;
 
     // TODO: Add the remaining controls
+
+//|____________________________________________________________________
+//|
+//| Render controls
+//|____________________________________________________________________
+
+    case 'm': // Toggles the state-sorted render queue
+      render_sorted = !render_sorted;
+      break;
+
+    case 'j': // Toggles the slow plane pose source
+      sim_tick_ms = (sim_tick_ms == SIM_TICK_MS) ? SLOW_SIM_TICK_MS : SIM_TICK_MS;   // Delay stays at one normal tick
+      break;
+
+    case '[': // Shorter contrails
+      contrails.SetLength(contrails.Length() / 2);
+      break;
+    case ']': // Longer contrails
+      contrails.SetLength(contrails.Length() * 2);
+      break;
   }
 
   gmtl::invert(view_mat, cam_pose);       // Updates view transform to reflect the change in camera transform
@@ -422,51 +584,130 @@ void ReshapeFunc(int w, int h)
 
 //|____________________________________________________________________
 //|
-//| Function: DrawCoordinateFrame
+//| Function: IdleFunc
 //|
+//! \param None.
+//! \return None.
+//!
+//! GLUT idle callback function: keeps redrawing at display rate, so the
+//! interpolated plane moves smoothly in between simulation ticks.
+//|____________________________________________________________________
+
+void IdleFunc(void)
+{
+  glutPostRedisplay();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SimTimerFunc
+//|
+//! \param value  [in] Unused.
+//! \return None.
+//!
+//! GLUT timer callback function: simulation tick, hands the current plane
+//! pose to the interpolator, runs the fleet autopilot and schedules the
+//! next tick.
+//|____________________________________________________________________
+
+void SimTimerFunc(int value)
+{
+  last_tick_ms = glutGet(GLUT_ELAPSED_TIME);
+
+  plane_interp.Push(plane_pose, last_tick_ms / 1000.0);
+  fleet.Update(jobs.get(), sim_tick_ms / 1000.0f);
+
+  glutTimerFunc(sim_tick_ms, SimTimerFunc, 0);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: ShowRenderStats
+//|
+//! \param None.
+//! \return None.
+//!
+//! Shows the render queue, terrain and contrail counters of the last
+//! frame in the title bar.
+//|____________________________________________________________________
+
+void ShowRenderStats()
+{
+  const RenderStats&  stats   = frame_stats;
+  const TerrainStats& tstats  = terrain.Stats();
+  char title[448];
+  int  n;
+
+  n = sprintf(title, "Plane Episode 1 | %s | draw calls %d | state changes %d (viewport %d, primitive %d, matrix %d, color %d)",
+              render_sorted ? "sorted" : "scene order", stats.draw_calls, stats.StateChanges(),
+              stats.viewport_changes, stats.pipeline_changes, stats.matrix_loads, stats.color_changes);
+
+  if (terrain.IsOpen()) {
+    n += sprintf(title + n, " | terrain %d tiles, %.1f/%.0f MB, load %.1f ms (avg %.1f, max %.1f), pending %d",
+                 tstats.resident_tiles, tstats.resident_bytes / 1048576.0, tstats.budget_bytes / 1048576.0,
+                 tstats.last_latency_ms, tstats.avg_latency_ms, tstats.max_latency_ms, tstats.pending_tiles);
+  }
+
+  sprintf(title + n, " | contrails %d samples, %d verts resident, appended %.0f verts/s (%s, %d stalls, %d overflows)",
+          contrails.Length(), contrails.Stats().resident, contrails.Stats().appended_per_sec,
+          stream_buffer.ModeName(), stream_buffer.Stats().stalls, stream_buffer.Stats().overflows);
+
+  glutSetWindowTitle(title);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BuildCoordinateFrame
+//|
+//! \param mesh        [out] Mesh receiving the geometry.
 //! \param l      [in] length of the three axes.
 //! \return None.
 //!
-//! Draws coordinate frame consisting of the three principal axes.
+//! Records coordinate frame consisting of the three principal axes.
 //|____________________________________________________________________
 
-void DrawCoordinateFrame(const float l)
+void BuildCoordinateFrame(Mesh& mesh, const float l)
 {
-  glBegin(GL_LINES);
+  MeshBuilder mb(mesh);
+
+  mb.Begin(GL_LINES);
     //x,y,zɫ
     // X axis is red
-    glColor3f( 1.0f, 0.0f, 0.0f);
-    glVertex3f(0.0f, 0.0f, 0.0f);
-	  glVertex3f(   l, 0.0f, 0.0f);
+    mb.Color3f( 1.0f, 0.0f, 0.0f);
+    mb.Vertex3f(0.0f, 0.0f, 0.0f);
+	  mb.Vertex3f(   l, 0.0f, 0.0f);
 
     // Y axis is green
-    glColor3f( 0.0f, 1.0f, 0.0f);
-    glVertex3f(0.0f, 0.0f, 0.0f);
-	  glVertex3f(0.0f,    l, 0.0f);
+    mb.Color3f( 0.0f, 1.0f, 0.0f);
+    mb.Vertex3f(0.0f, 0.0f, 0.0f);
+	  mb.Vertex3f(0.0f,    l, 0.0f);
 
     // Z axis is blue
-    glColor3f( 0.0f, 0.0f, 1.0f);
-    glVertex3f(0.0f, 0.0f, 0.0f);
-	  glVertex3f(0.0f, 0.0f,    l);
-  glEnd();
+    mb.Color3f( 0.0f, 0.0f, 1.0f);
+    mb.Vertex3f(0.0f, 0.0f, 0.0f);
+	  mb.Vertex3f(0.0f, 0.0f,    l);
+  mb.End();
 }
 
 
 //|____________________________________________________________________
 //|
-//| Function: DrawPlane
+//| Function: BuildPlane
 //|
+//! \param mesh        [out] Mesh receiving the geometry.
 //! \param width       [in] Width  of the plane.
 //! \param length      [in] Length of the plane.
 //! \param height      [in] Height of the plane.
 //! \return None.
 //!
-//! Draws the plane.
+//! Records the plane.
 //|____________________________________________________________________
 
 //Ʒģ
-void DrawPlane(const float width, const float length, const float height)
+void BuildPlane(Mesh& mesh, const float width, const float length, const float height)
 {
+  MeshBuilder mb(mesh);
+
   float w = width/2;
   float l = length/2;
   
@@ -479,236 +720,236 @@ void DrawPlane(const float width, const float length, const float height)
   6,ɻ,ɫ
   7,ɻ.ɫ
   */
-     glBegin(GL_POLYGON);
+     mb.Begin(GL_POLYGON);
     //1
     //ŵ²
-    glColor3f(1.0f, 1.0f, 1.0f);//ɫǰɫwhite
-    glVertex3f(0.0f, 1.0f, 0.5f);//
-    glVertex3f(0.0f, 0.25f, 1.0f);//
-    glVertex3f(0.0f, 0.5f, 4.0f);//
-    glVertex3f(0.0f, 1.4f, 2.0f);//
-    glColor3f(1.0f, 1.0f, 1.0f);//ɫǰɫwhite
+    mb.Color3f(1.0f, 1.0f, 1.0f);//ɫǰɫwhite
+    mb.Vertex3f(0.0f, 1.0f, 0.5f);//
+    mb.Vertex3f(0.0f, 0.25f, 1.0f);//
+    mb.Vertex3f(0.0f, 0.5f, 4.0f);//
+    mb.Vertex3f(0.0f, 1.4f, 2.0f);//
+    mb.Color3f(1.0f, 1.0f, 1.0f);//ɫǰɫwhite
 
     //ŵϲ
-    glColor3f(0.0f, 3.0f, 1.0f);//ɫɫblue
-    glVertex3f(0.0f, 1.4f, 2.0f);//
-    glVertex3f(0.0f, 3.0f, 1.0f);//
-    glVertex3f(0.0f, 3.0f, 0.0f);//
-    glVertex3f(0.0f, 1.0f, 0.5f);//
-    glColor3f(0.0f, 3.0f, 1.0f);//ɫɫblue
-    glEnd();
+    mb.Color3f(0.0f, 3.0f, 1.0f);//ɫɫblue
+    mb.Vertex3f(0.0f, 1.4f, 2.0f);//
+    mb.Vertex3f(0.0f, 3.0f, 1.0f);//
+    mb.Vertex3f(0.0f, 3.0f, 0.0f);//
+    mb.Vertex3f(0.0f, 1.0f, 0.5f);//
+    mb.Color3f(0.0f, 3.0f, 1.0f);//ɫɫblue
+    mb.End();
 
     //2
-    glBegin(GL_POLYGON);
+    mb.Begin(GL_POLYGON);
     //ŵҰ벿
-    glColor3f(1.0f, 1.0f, 1.0f);//ɫǰwhite
-    glVertex3f(0.0f, 2.0f, 0.25f);//
-    glVertex3f(1.0f, 2.0f, -0.5f);//
-    glVertex3f(2.0f, 2.0f, -0.5f);//
-    glVertex3f(0.0f, 2.0f, 1.40f);//
+    mb.Color3f(1.0f, 1.0f, 1.0f);//ɫǰwhite
+    mb.Vertex3f(0.0f, 2.0f, 0.25f);//
+    mb.Vertex3f(1.0f, 2.0f, -0.5f);//
+    mb.Vertex3f(2.0f, 2.0f, -0.5f);//
+    mb.Vertex3f(0.0f, 2.0f, 1.40f);//
    
     //ŵ벿
-    glColor3f(1.0f, 1.0f, 1.0f);//ɫǰwhite
-    glVertex3f(0.0f, 2.0f, 0.25f);//
-    glVertex3f(-1.0f, 2.0f, -0.5f);//
-    glVertex3f(-2.0f, 2.0f, -0.5f);//
-    glVertex3f(0.0f, 2.0f, 1.40f);//
-    glEnd();
+    mb.Color3f(1.0f, 1.0f, 1.0f);//ɫǰwhite
+    mb.Vertex3f(0.0f, 2.0f, 0.25f);//
+    mb.Vertex3f(-1.0f, 2.0f, -0.5f);//
+    mb.Vertex3f(-2.0f, 2.0f, -0.5f);//
+    mb.Vertex3f(0.0f, 2.0f, 1.40f);//
+    mb.End();
 
     //3
     //ͷ
-    glBegin(GL_TRIANGLES);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred
-    glVertex3f(-1.0f, 0.5f, 10.0f);//
-    glVertex3f(1.0f, 0.5f, 10.0f);//
-    glVertex3f(0.0f, 0.0f, 13.5f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(1.0f, 0.5f, 10.0f);//
-    glVertex3f(2.0f, -0.2f, 10.0f);//
-    glVertex3f(0.0f, 0.0f, 13.5f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred
-    glVertex3f(2.0f, -0.2f, 10.0f);//
-    glVertex3f(-2.0f, -0.2f, 10.0f);//
-    glVertex3f(0.0f, 0.0f, 13.5f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(-2.0f, -0.2f, 10.0f);//
-    glVertex3f(-1.0f, 0.5f, 10.0f);//
-    glVertex3f(0.0f, 0.0f, 13.5f);//
-    glEnd();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred
+    mb.Vertex3f(-1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(0.0f, 0.0f, 13.5f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(0.0f, 0.0f, 13.5f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred
+    mb.Vertex3f(2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(-2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(0.0f, 0.0f, 13.5f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(-2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(-1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(0.0f, 0.0f, 13.5f);//
+    mb.End();
 
     //4
     //ɻʻ
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 10.0f);//
-    glVertex3f(0.25f, 1.5f, 9.25f);//
-    glVertex3f(-0.25f, 1.5f, 9.25f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 10.0f);//
-    glVertex3f(0.25f, 1.5f, 9.25f);//
-    glVertex3f(1.0f, 0.5f, 9.0f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 10.0f);//
-    glVertex3f(-0.25f, 1.5f, 9.25f);//
-    glVertex3f(-1.0f, 0.5f, 9.0f);//
-    glEnd();
-
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(-1.0f, 0.5f, 9.0f);//
-    glVertex3f(-0.25f, 1.5f, 9.25f);//
-    glVertex3f(-0.25f, 1.5f, 7.75f);//
-    glVertex3f(-1.0f, 0.5f, 8.0f);//
-    glEnd();
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.25f, 1.5f, 9.25f);//
-    glVertex3f(-0.25f, 1.5f, 9.25f);//
-    glVertex3f(-0.25f, 1.5f, 7.75f);//
-    glVertex3f(0.25f, 1.5f, 7.75f);//
-    glEnd();
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(1.0f, 0.5f, 9.0f);//
-    glVertex3f(0.25f, 1.5f, 9.25f);//
-    glVertex3f(0.25f, 1.5f, 7.75f);//
-    glVertex3f(1.0f, 0.5f, 8.0f);//
-    glEnd();
-
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 7.0f);//
-    glVertex3f(0.25f, 1.5f, 7.75f);//
-    glVertex3f(-0.25f, 1.5f, 7.75f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 7.0f);//
-    glVertex3f(0.25f, 1.5f, 7.75f);//
-    glVertex3f(1.0f, 0.5f, 8.0f);//
-    glEnd();
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);//ɫblue
-    glVertex3f(0.0f, 0.5f, 7.0f);//
-    glVertex3f(-0.25f, 1.5f, 7.75f);//
-    glVertex3f(-1.0f, 0.5f, 8.0f);//
-    glEnd();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(-0.25f, 1.5f, 9.25f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(1.0f, 0.5f, 9.0f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(-0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(-1.0f, 0.5f, 9.0f);//
+    mb.End();
+
+    mb.Begin(GL_QUADS);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(-1.0f, 0.5f, 9.0f);//
+    mb.Vertex3f(-0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(-0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(-1.0f, 0.5f, 8.0f);//
+    mb.End();
+    mb.Begin(GL_QUADS);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(-0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(-0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(0.25f, 1.5f, 7.75f);//
+    mb.End();
+    mb.Begin(GL_QUADS);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(1.0f, 0.5f, 9.0f);//
+    mb.Vertex3f(0.25f, 1.5f, 9.25f);//
+    mb.Vertex3f(0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(1.0f, 0.5f, 8.0f);//
+    mb.End();
+
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 7.0f);//
+    mb.Vertex3f(0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(-0.25f, 1.5f, 7.75f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 7.0f);//
+    mb.Vertex3f(0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(1.0f, 0.5f, 8.0f);//
+    mb.End();
+    mb.Begin(GL_TRIANGLES);
+    mb.Color3f(0.0f, 1.0f, 1.0f);//ɫblue
+    mb.Vertex3f(0.0f, 0.5f, 7.0f);//
+    mb.Vertex3f(-0.25f, 1.5f, 7.75f);//
+    mb.Vertex3f(-1.0f, 0.5f, 8.0f);//
+    mb.End();
 
     //5
     //
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred
-    glVertex3f(-0.25f, 0.25f, 1.0f);//
-    glVertex3f(0.25f, 0.25f, 1.0f);//
-    glVertex3f(0.6f, 0.5f, 4.0f);//
-    glVertex3f(-0.6f, 0.5f, 4.0f);//
-    glEnd();
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred
-    glVertex3f(0.6f, 0.5f, 4.0f);//
-    glVertex3f(-0.6f, 0.5f, 4.0f);//
-    glVertex3f(-1.0f, 0.5f, 10.0f);//
-    glVertex3f(1.0f, 0.5f, 10.0f);//
-    glEnd();
-
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred
-    glVertex3f(-0.5f, -0.2f, -1.0f);//
-    glVertex3f(-0.25f, 0.2f, 1.0f);//
-    glVertex3f(0.25f, 0.2f, 1.0f);//
-    glVertex3f(0.5f, -0.2f, -1.0f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(2.0f, -0.2f, 10.0f);//
-    glVertex3f(1.0f, 0.5f, 10.0f);//
-    glVertex3f(0.6f, 0.5f, 4.0f);//
-    glVertex3f(0.25f, 0.2f, 1.0f);//
-    glVertex3f(0.5f, -0.2f, -1.0f);//
-    glVertex3f(0.5f, -0.2f, -1.0f);//
-    glVertex3f(1.2f, -0.2f, 4.0f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(0.0f, 0.0f, 13.5f);//
-    glVertex3f(-2.0f,-0.2f, 10.0f);//
-    glVertex3f(-0.5f,-0.2f, -1.0f);//
-    glVertex3f(0.5f, -0.2f, -1.0f);//
-    glVertex3f(2.0f, -0.2f, 10.0f);//
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(-2.0f, -0.2f, 10.0f);//
-    glVertex3f(-1.0f, 0.5f, 10.0f);//
-    glVertex3f(-0.6f, 0.5f, 4.0f);//
-    glVertex3f(-0.25f, 0.2f, 1.0f);//
-    glVertex3f(-0.5f, -0.2f, -1.0f);//
-    glVertex3f(-0.5f, -0.2f, -1.0f);//
-    glVertex3f(-1.2f, -0.2f, 4.0f);//
-    glEnd();
+    mb.Begin(GL_QUADS);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred
+    mb.Vertex3f(-0.25f, 0.25f, 1.0f);//
+    mb.Vertex3f(0.25f, 0.25f, 1.0f);//
+    mb.Vertex3f(0.6f, 0.5f, 4.0f);//
+    mb.Vertex3f(-0.6f, 0.5f, 4.0f);//
+    mb.End();
+    mb.Begin(GL_QUADS);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred
+    mb.Vertex3f(0.6f, 0.5f, 4.0f);//
+    mb.Vertex3f(-0.6f, 0.5f, 4.0f);//
+    mb.Vertex3f(-1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(1.0f, 0.5f, 10.0f);//
+    mb.End();
+
+    mb.Begin(GL_QUADS);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred
+    mb.Vertex3f(-0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(-0.25f, 0.2f, 1.0f);//
+    mb.Vertex3f(0.25f, 0.2f, 1.0f);//
+    mb.Vertex3f(0.5f, -0.2f, -1.0f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(0.6f, 0.5f, 4.0f);//
+    mb.Vertex3f(0.25f, 0.2f, 1.0f);//
+    mb.Vertex3f(0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(1.2f, -0.2f, 4.0f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(0.0f, 0.0f, 13.5f);//
+    mb.Vertex3f(-2.0f,-0.2f, 10.0f);//
+    mb.Vertex3f(-0.5f,-0.2f, -1.0f);//
+    mb.Vertex3f(0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(2.0f, -0.2f, 10.0f);//
+    mb.End();
+
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(-2.0f, -0.2f, 10.0f);//
+    mb.Vertex3f(-1.0f, 0.5f, 10.0f);//
+    mb.Vertex3f(-0.6f, 0.5f, 4.0f);//
+    mb.Vertex3f(-0.25f, 0.2f, 1.0f);//
+    mb.Vertex3f(-0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(-0.5f, -0.2f, -1.0f);//
+    mb.Vertex3f(-1.2f, -0.2f, 4.0f);//
+    mb.End();
 
     //6
     //ɻ
-    glBegin(GL_POLYGON);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred 
-    glVertex3f(-1.75f, 0.0f, 10.0f);//
-    glVertex3f(-5.0f, 0.0f, 7.5f);//
-    glVertex3f(-5.0f, 0.25f, 4.1f);//
-    glVertex3f(-1.0f, 0.25f, 4.0f);//
-    glVertex3f(-1.75f, 0.0f, 10.0f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(-5.0f, 0.0f, 7.5f);//
-    glVertex3f(-5.0f, 0.25f, 4.1f);//
-    glVertex3f(-9.0f, 0.45f, 2.5f);//
-    glVertex3f(-10.0f, 0.2f, 5.5f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-
-    glBegin(GL_POLYGON);
-    glColor3f(1.0f, 0.0f, 0.0f);//ɫǺred 
-    glVertex3f(1.75f, 0.0f, 10.0f);//
-    glVertex3f(5.0f, 0.0f, 7.5f);//
-    glVertex3f(5.0f, 0.25f, 4.1f);//
-    glVertex3f(1.0f, 0.25f, 4.0f);//
-    glVertex3f(1.75f, 0.0f, 10.0f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-    glColor3f(0.0f, 0.0f, 0.0f);//ɫǺblack
-    glVertex3f(5.0f, 0.0f, 7.5f);//
-    glVertex3f(5.0f, 0.25f, 4.1f);//
-    glVertex3f(9.0f, 0.45f, 2.5f);//
-    glVertex3f(10.0f, 0.2f, 5.5f);//
-    glEnd();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred 
+    mb.Vertex3f(-1.75f, 0.0f, 10.0f);//
+    mb.Vertex3f(-5.0f, 0.0f, 7.5f);//
+    mb.Vertex3f(-5.0f, 0.25f, 4.1f);//
+    mb.Vertex3f(-1.0f, 0.25f, 4.0f);//
+    mb.Vertex3f(-1.75f, 0.0f, 10.0f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(-5.0f, 0.0f, 7.5f);//
+    mb.Vertex3f(-5.0f, 0.25f, 4.1f);//
+    mb.Vertex3f(-9.0f, 0.45f, 2.5f);//
+    mb.Vertex3f(-10.0f, 0.2f, 5.5f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(1.0f, 0.0f, 0.0f);//ɫǺred 
+    mb.Vertex3f(1.75f, 0.0f, 10.0f);//
+    mb.Vertex3f(5.0f, 0.0f, 7.5f);//
+    mb.Vertex3f(5.0f, 0.25f, 4.1f);//
+    mb.Vertex3f(1.0f, 0.25f, 4.0f);//
+    mb.Vertex3f(1.75f, 0.0f, 10.0f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(0.0f, 0.0f, 0.0f);//ɫǺblack
+    mb.Vertex3f(5.0f, 0.0f, 7.5f);//
+    mb.Vertex3f(5.0f, 0.25f, 4.1f);//
+    mb.Vertex3f(9.0f, 0.45f, 2.5f);//
+    mb.Vertex3f(10.0f, 0.2f, 5.5f);//
+    mb.End();
 
     //7
     //ɻ
-    glBegin(GL_POLYGON);
-    glColor3f(1.0f, 1.0f, 0.0f);//ɫǻɫyellow
-    glVertex3f(-0.5f, -0.25f,-1.0f);//
-    glVertex3f(-0.55f, 0.1f, 1.0f);//
-    glVertex3f(-2.75f, 0.1f,-0.25f);//
-    glVertex3f(-2.5f, -0.25f,-1.1f);//
-    glEnd();
-    glBegin(GL_POLYGON);
-    glColor3f(1.0f, 1.0f, 0.0f);//ɫǻɫyellow
-    glVertex3f(0.5f, -0.25f, -1.0f);//
-    glVertex3f(0.55f, 0.1f, 1.0f);//
-    glVertex3f(2.75f, 0.1f, -0.25f);//
-    glVertex3f(2.5f, -0.25f, -1.1f);//
-    glEnd();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(1.0f, 1.0f, 0.0f);//ɫǻɫyellow
+    mb.Vertex3f(-0.5f, -0.25f,-1.0f);//
+    mb.Vertex3f(-0.55f, 0.1f, 1.0f);//
+    mb.Vertex3f(-2.75f, 0.1f,-0.25f);//
+    mb.Vertex3f(-2.5f, -0.25f,-1.1f);//
+    mb.End();
+    mb.Begin(GL_POLYGON);
+    mb.Color3f(1.0f, 1.0f, 0.0f);//ɫǻɫyellow
+    mb.Vertex3f(0.5f, -0.25f, -1.0f);//
+    mb.Vertex3f(0.55f, 0.1f, 1.0f);//
+    mb.Vertex3f(2.75f, 0.1f, -0.25f);//
+    mb.Vertex3f(2.5f, -0.25f, -1.1f);//
+    mb.End();
 
     /*
     glBegin(GL_POLYGON); 
@@ -730,11 +971,19 @@ void DrawPlane(const float width, const float length, const float height)
 
 int main(int argc, char **argv)
 { 
+  if (argc > 1 && strcmp(argv[1], "--fleet-bench") == 0)
+    return RunFleetBenchmark(argc > 2 ? atoi(argv[2]) : 0);
+
   InitMatrices();
+  InitMeshes();
+  InitTerrain();
+  InitFleet();
+
+  plane_interp.Push(plane_pose, 0.0);       // First simulation state
 
   glutInit(&argc, argv);
 
-  glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
   glutInitWindowSize(w_width, w_height);
   
   glutCreateWindow("Plane Episode 1");
@@ -742,6 +991,8 @@ int main(int argc, char **argv)
   glutDisplayFunc(DisplayFunc);
   glutReshapeFunc(ReshapeFunc);
   glutKeyboardFunc(KeyboardFunc);
+  glutIdleFunc(IdleFunc);
+  glutTimerFunc(sim_tick_ms, SimTimerFunc, 0);
   
   InitGL();
 
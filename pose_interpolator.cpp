@@ -0,0 +1,244 @@
+//|___________________________________________________________________
+//!
+//! \file pose_interpolator.cpp
+//!
+//! \brief Render-time pose interpolation and dead-reckoning implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <math.h>
+
+#include "pose_interpolator.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float PoseInterpolator::MAX_EXTRAPOLATION = 0.25f;
+const float PoseInterpolator::CORRECTION_TIME   = 0.10f;
+const float PoseInterpolator::MAX_POS_ERROR     = 2.0f;
+const float PoseInterpolator::MAX_ROT_ERROR     = gmtl::Math::deg2Rad(30.0f);
+
+//|____________________________________________________________________
+//|
+//| Function: RotationVector
+//|
+//! \param q       [in] Unit quaternion.
+//! \return Rotation axis scaled by the rotation angle (rads), taking the
+//!         shortest way round.
+//|____________________________________________________________________
+
+static gmtl::Vec3f RotationVector(const gmtl::Quatf& q)
+{
+  float sign = (q[3] < 0.0f) ? -1.0f : 1.0f;
+  float w    = sign * q[3];
+  if (w > 1.0f) w = 1.0f;
+
+  float s = sqrtf(1.0f - w*w);
+  if (s < 1e-6f) return gmtl::Vec3f(0.0f, 0.0f, 0.0f);
+
+  float k = sign * 2.0f * acosf(w) / s;
+  return gmtl::Vec3f(q[0]*k, q[1]*k, q[2]*k);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FromRotationVector
+//|
+//! \param v       [in] Rotation axis scaled by the rotation angle (rads).
+//! \return Corresponding unit quaternion.
+//|____________________________________________________________________
+
+static gmtl::Quatf FromRotationVector(const gmtl::Vec3f& v)
+{
+  float angle = gmtl::length(v);
+  if (angle < 1e-6f) return gmtl::Quatf();
+
+  float k = sinf(angle/2) / angle;
+  return gmtl::Quatf(v[0]*k, v[1]*k, v[2]*k, cosf(angle/2));
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PoseInterpolator::PoseInterpolator
+//|
+//! \param delay   [in] Interpolation delay in secs, normally one simulation tick.
+//! \return None.
+//|____________________________________________________________________
+
+PoseInterpolator::PoseInterpolator(float delay)
+  : count_(0), delay_(delay), corr_start_(0.0), last_eval_(-1.0), extrapolating_(false)
+{
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PoseInterpolator::Push
+//|
+//! \param pose    [in] Simulation pose (rotation + translation).
+//! \param time    [in] Simulation time stamp in secs.
+//! \return None.
+//!
+//! Stores the sample with velocities derived from the previous one. If the
+//! pose shown last frame differs from where the new sample puts it (e.g.
+//! dead-reckoning guessed wrong), that error is kept as a correction that
+//! fades out over CORRECTION_TIME, unless it is beyond the error bounds.
+//|____________________________________________________________________
+
+void PoseInterpolator::Push(const gmtl::Matrix44f& pose, double time)
+{
+  // What was displayed last, before this sample existed
+  gmtl::Vec3f shown_pos;
+  gmtl::Quatf shown_rot;
+  bool        valid = (count_ > 0 && last_eval_ >= 0.0);
+
+  if (valid) {
+    gmtl::Matrix44f shown = Evaluate(last_eval_);
+    shown_pos = gmtl::makeTrans<gmtl::Vec3f>(shown);
+    gmtl::set(shown_rot, shown);
+  }
+
+  PoseSample s;
+  s.time = time;
+  s.pos  = gmtl::makeTrans<gmtl::Vec3f>(pose);
+  gmtl::set(s.rot, pose);
+  gmtl::normalize(s.rot);
+
+  if (count_ > 0) {
+    const PoseSample& prev = samples_[count_ - 1];
+    float dt = (float) (time - prev.time);
+
+    if (dt > 0.0f) {
+      gmtl::Quatf prev_conj = prev.rot;
+      gmtl::conj(prev_conj);
+
+      s.lin_vel = (s.pos - prev.pos) * (1.0f / dt);
+      s.ang_vel = RotationVector(s.rot * prev_conj) * (1.0f / dt);   // World frame: rot = dq * prev.rot
+    }
+  }
+
+  if (count_ == HISTORY) {
+    for (int i = 1; i < HISTORY; ++i) samples_[i - 1] = samples_[i];
+    --count_;
+  }
+  samples_[count_++] = s;
+
+  // Error between what was shown and where the pose really is now
+  corr_pos_ = gmtl::Vec3f(0.0f, 0.0f, 0.0f);
+  corr_rot_ = gmtl::Quatf();
+
+  if (valid) {
+    gmtl::Vec3f new_pos;
+    gmtl::Quatf new_rot;
+    bool        extrapolating;
+    EvaluateRaw(last_eval_, new_pos, new_rot, extrapolating);
+
+    gmtl::Quatf new_conj = new_rot;
+    gmtl::conj(new_conj);
+
+    gmtl::Vec3f err_pos = shown_pos - new_pos;
+    gmtl::Quatf err_rot = shown_rot * new_conj;
+
+    if (gmtl::length(err_pos) <= MAX_POS_ERROR && gmtl::length(RotationVector(err_rot)) <= MAX_ROT_ERROR) {
+      corr_pos_   = err_pos;
+      corr_rot_   = err_rot;
+      corr_start_ = last_eval_;
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PoseInterpolator::EvaluateRaw
+//|
+//! \param time            [in]  Real time in secs.
+//! \param pos             [out] Interpolated/extrapolated position.
+//! \param rot             [out] Interpolated/extrapolated rotation.
+//! \param extrapolating   [out] True if past the latest sample.
+//! \return None.
+//!
+//! Pose at (time - delay), without correction.
+//|____________________________________________________________________
+
+void PoseInterpolator::EvaluateRaw(double time, gmtl::Vec3f& pos, gmtl::Quatf& rot, bool& extrapolating) const
+{
+  double t = time - delay_;
+  extrapolating = false;
+
+  if (count_ == 0) {
+    pos = gmtl::Vec3f(0.0f, 0.0f, 0.0f);
+    rot = gmtl::Quatf();
+    return;
+  }
+
+  // Before the oldest sample: hold it
+  if (t <= samples_[0].time) {
+    pos = samples_[0].pos;
+    rot = samples_[0].rot;
+    return;
+  }
+
+  // Between two samples: lerp position, slerp rotation
+  for (int i = 0; i + 1 < count_; ++i) {
+    const PoseSample& a = samples_[i];
+    const PoseSample& b = samples_[i + 1];
+
+    if (t <= b.time) {
+      float k = (float) ((t - a.time) / (b.time - a.time));
+      pos = a.pos + (b.pos - a.pos) * k;
+      gmtl::slerp(rot, k, a.rot, b.rot);
+      return;
+    }
+  }
+
+  // Past the latest sample: dead-reckoning from its velocities
+  const PoseSample& s = samples_[count_ - 1];
+  float dt = (float) (t - s.time);
+  if (dt > MAX_EXTRAPOLATION) dt = MAX_EXTRAPOLATION;
+
+  pos = s.pos + s.lin_vel * dt;
+  rot = FromRotationVector(s.ang_vel * dt) * s.rot;
+  gmtl::normalize(rot);
+  extrapolating = true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PoseInterpolator::Evaluate
+//|
+//! \param time    [in] Real time in secs.
+//! \return Pose to display, including the fading correction.
+//|____________________________________________________________________
+
+gmtl::Matrix44f PoseInterpolator::Evaluate(double time)
+{
+  gmtl::Vec3f pos;
+  gmtl::Quatf rot;
+  EvaluateRaw(time, pos, rot, extrapolating_);
+
+  float fade = 1.0f - (float) ((time - corr_start_) / CORRECTION_TIME);
+  if (fade > 1.0f) fade = 1.0f;
+
+  if (fade > 0.0f) {
+    gmtl::Quatf corr;
+    gmtl::slerp(corr, fade, gmtl::Quatf(), corr_rot_);
+
+    pos = pos + corr_pos_ * fade;
+    rot = corr * rot;
+    gmtl::normalize(rot);
+  }
+
+  last_eval_ = time;
+
+  gmtl::Matrix44f pose;
+  gmtl::setRot(pose, rot);
+  gmtl::setTrans(pose, pos);
+  pose.setState(gmtl::Matrix44f::AFFINE);
+
+  return pose;
+}
@@ -0,0 +1,96 @@
+//|___________________________________________________________________
+//!
+//! \file pose_interpolator.h
+//!
+//! \brief Render-time pose interpolation and dead-reckoning.
+//!
+//! The simulation pushes time-stamped poses at its own rate. The renderer
+//! asks for the pose at display time and gets:
+//!
+//!   - slerp (rotation) + lerp (position) between the two samples around
+//!     the render time, which lags real time by a fixed delay (one tick of
+//!     the normal simulation rate),
+//!   - dead-reckoning from linear and angular velocity when the next sample
+//!     is late, or when the source runs slower than the delay, limited to
+//!     MAX_EXTRAPOLATION seconds,
+//!   - a correction that fades out the difference between what was shown
+//!     and the real pose once the late sample arrives. Errors larger than
+//!     the bounds below are snapped instead of blended.
+//|___________________________________________________________________
+
+#ifndef POSE_INTERPOLATOR_H
+#define POSE_INTERPOLATOR_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <gmtl/gmtl.h>
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+struct PoseSample
+{
+  double       time;       // Simulation time stamp in secs
+  gmtl::Vec3f  pos;
+  gmtl::Quatf  rot;
+  gmtl::Vec3f  lin_vel;    // Units per sec
+  gmtl::Vec3f  ang_vel;    // World axis * rads per sec
+};
+
+//|____________________________________________________________________
+//|
+//| Class: PoseInterpolator
+//|
+//! Keeps the latest simulation samples of one pose and evaluates it at
+//! arbitrary render times.
+//|____________________________________________________________________
+
+class PoseInterpolator
+{
+public:
+  // Extrapolation and correction limits
+  static const float MAX_EXTRAPOLATION;    // Secs of dead-reckoning past the latest sample
+  static const float CORRECTION_TIME;      // Secs over which a correction fades out
+  static const float MAX_POS_ERROR;        // Position error above which the pose snaps
+  static const float MAX_ROT_ERROR;        // Rotation error (rads) above which the pose snaps
+
+  //! The delay is fixed: changing it while running would move the render
+  //! time back in one step. HISTORY samples must cover it at the normal
+  //! simulation rate.
+  explicit PoseInterpolator(float delay = 0.05f);
+
+  float Delay() const { return delay_; }
+
+  //! Records the simulation pose at the given time (secs). Samples must
+  //! arrive in increasing time order.
+  void Push(const gmtl::Matrix44f& pose, double time);
+
+  //! Returns the pose to display at the given real time (secs).
+  gmtl::Matrix44f Evaluate(double time);
+
+  bool Extrapolating() const { return extrapolating_; }
+
+private:
+  void EvaluateRaw(double time, gmtl::Vec3f& pos, gmtl::Quatf& rot, bool& extrapolating) const;
+
+  static const int HISTORY = 3;
+
+  PoseSample  samples_[HISTORY];           // Oldest first
+  int         count_;
+  float       delay_;
+
+  // Correction applied on top of the raw pose, fading out from corr_start_
+  gmtl::Vec3f corr_pos_;
+  gmtl::Quatf corr_rot_;
+  double      corr_start_;
+
+  double      last_eval_;
+  bool        extrapolating_;
+};
+
+#endif // POSE_INTERPOLATOR_H
@@ -0,0 +1,494 @@
+//|___________________________________________________________________
+//!
+//! \file render_queue.cpp
+//!
+//! \brief State-sorted render queue implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include "render_queue.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const int VIEWPORT_SHIFT = 56;
+const int STATE_SHIFT    = 48;
+const int MESH_SHIFT     = 32;
+
+const GLenum STATE_MODES[PS_COUNT] = { GL_LINES, GL_TRIANGLES };
+
+//|____________________________________________________________________
+//|
+//| Function: LoadViewport
+//|
+//! \param viewport    [in] Viewport rectangle, projection and view transform.
+//! \return None.
+//|____________________________________________________________________
+
+void LoadViewport(const Viewport& viewport)
+{
+  glViewport(viewport.x, viewport.y, viewport.width, viewport.height);
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  gluPerspective(viewport.fov, viewport.aspect, viewport.z_near, viewport.z_far);
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixf(viewport.view_mat.mData);     // M = V^-1
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::MeshBuilder
+//|
+//! \param mesh    [in] Mesh that receives the recorded batches.
+//! \return None.
+//|____________________________________________________________________
+
+MeshBuilder::MeshBuilder(Mesh& mesh)
+  : mesh_(mesh), mode_(GL_TRIANGLES), open_(false)
+{
+  color_[0] = color_[1] = color_[2] = 1.0f;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Begin
+//|
+//! \param mode    [in] GL_LINES, GL_TRIANGLES, GL_QUADS or GL_POLYGON.
+//! \return None.
+//!
+//! Starts a batch. Like glBegin, a nested Begin is ignored and the
+//! vertices keep going to the batch that is already open.
+//|____________________________________________________________________
+
+void MeshBuilder::Begin(GLenum mode)
+{
+  if (open_) return;
+
+  mode_ = mode;
+  open_ = true;
+  verts_.clear();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Color3f
+//|
+//! \param r,g,b   [in] Current color, applied to the following vertices.
+//! \return None.
+//|____________________________________________________________________
+
+void MeshBuilder::Color3f(float r, float g, float b)
+{
+  color_[0] = r;
+  color_[1] = g;
+  color_[2] = b;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Vertex3f
+//|
+//! \param x,y,z   [in] Vertex position in the mesh's local frame.
+//! \return None.
+//|____________________________________________________________________
+
+void MeshBuilder::Vertex3f(float x, float y, float z)
+{
+  if (!open_) return;
+
+  MeshVertex v = { { x, y, z }, { color_[0], color_[1], color_[2] } };
+  verts_.push_back(v);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::End
+//|
+//! \param None.
+//! \return None.
+//!
+//! Closes the batch and converts it to lines or triangles.
+//|____________________________________________________________________
+
+void MeshBuilder::End()
+{
+  if (!open_) return;
+  open_ = false;
+
+  MeshBatch batch;
+  size_t n = verts_.size();
+
+  switch (mode_) {
+    case GL_LINES:
+      batch.state = PS_LINES;
+      batch.verts.assign(verts_.begin(), verts_.begin() + (n - n % 2));
+      break;
+
+    case GL_TRIANGLES:
+      batch.state = PS_TRIANGLES;
+      batch.verts.assign(verts_.begin(), verts_.begin() + (n - n % 3));
+      break;
+
+    case GL_QUADS:                             // Each quad becomes two triangles
+      batch.state = PS_TRIANGLES;
+      for (size_t i = 0; i + 3 < n; i += 4) {
+        batch.verts.push_back(verts_[i]);
+        batch.verts.push_back(verts_[i + 1]);
+        batch.verts.push_back(verts_[i + 2]);
+        batch.verts.push_back(verts_[i]);
+        batch.verts.push_back(verts_[i + 2]);
+        batch.verts.push_back(verts_[i + 3]);
+      }
+      break;
+
+    case GL_POLYGON:                           // Convex polygon becomes a triangle fan
+      batch.state = PS_TRIANGLES;
+      for (size_t i = 1; i + 1 < n; ++i) {
+        batch.verts.push_back(verts_[0]);
+        batch.verts.push_back(verts_[i]);
+        batch.verts.push_back(verts_[i + 1]);
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  if (!batch.verts.empty()) mesh_.batches.push_back(batch);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::RenderQueue
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+RenderQueue::RenderQueue()
+  : cur_viewport_(-1), color_valid_(false)
+{
+  cur_color_[0] = cur_color_[1] = cur_color_[2] = 0.0f;
+  stats_ = RenderStats();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::AddMesh
+//|
+//! \param mesh    [in] Static geometry to register.
+//! \return Mesh id used by Submit().
+//|____________________________________________________________________
+
+int RenderQueue::AddMesh(const Mesh& mesh)
+{
+  meshes_.push_back(mesh);
+  return (int) meshes_.size() - 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::BeginFrame
+//|
+//! \param None.
+//! \return None.
+//!
+//! Drops last frame's viewports and items and resets the counters.
+//|____________________________________________________________________
+
+void RenderQueue::BeginFrame()
+{
+  viewports_.clear();
+  items_.clear();
+  stats_ = RenderStats();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::AddViewport
+//|
+//! \param viewport    [in] Viewport rectangle, projection and view transform.
+//! \return Viewport id used by Submit().
+//|____________________________________________________________________
+
+int RenderQueue::AddViewport(const Viewport& viewport)
+{
+  viewports_.push_back(viewport);
+  return (int) viewports_.size() - 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::Submit
+//|
+//! \param viewport    [in] Viewport id returned by AddViewport().
+//! \param mesh        [in] Mesh id returned by AddMesh().
+//! \param model_mat   [in] Mesh pose in world coordinates.
+//! \return None.
+//!
+//! Queues one draw item per batch of the mesh.
+//|____________________________________________________________________
+
+void RenderQueue::Submit(int viewport, int mesh, const gmtl::Matrix44f& model_mat)
+{
+  const Mesh& m = meshes_[mesh];
+
+  for (int b = 0; b < (int) m.batches.size(); ++b) {
+    DrawItem item = { viewport, mesh, b, model_mat };
+    items_.push_back(item);
+  }
+
+  stats_.items += (int) m.batches.size();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::MakeKey
+//|
+//! \param item    [in] Draw item.
+//! \param depth   [in] View space distance of the item's origin.
+//! \return 64-bit sort key (viewport | pipeline state | mesh | depth).
+//|____________________________________________________________________
+
+unsigned long long RenderQueue::MakeKey(const DrawItem& item, float depth) const
+{
+  const Viewport& vp = viewports_[item.viewport];
+
+  float d = (depth - vp.z_near) / (vp.z_far - vp.z_near);
+  if (d < 0.0f) d = 0.0f;
+  if (d > 1.0f) d = 1.0f;
+
+  unsigned long long key = 0;
+  key |= (unsigned long long) (item.viewport & 0xFF)                       << VIEWPORT_SHIFT;
+  key |= (unsigned long long) (meshes_[item.mesh].batches[item.batch].state & 0xFF) << STATE_SHIFT;
+  key |= (unsigned long long) (item.mesh & 0xFFFF)                         << MESH_SHIFT;
+  key |= (unsigned long long) (unsigned int) (d * 4294967295.0);
+
+  return key;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::RadixSort
+//|
+//! \param None.
+//! \return None.
+//!
+//! LSD radix sort of entries_ by key, 8 bits per pass. Passes where all
+//! keys share the same digit are skipped. The sort is stable, so items
+//! with equal keys keep their submission order.
+//|____________________________________________________________________
+
+void RenderQueue::RadixSort()
+{
+  size_t n = entries_.size();
+  scratch_.resize(n);
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t count[256] = { 0 };
+
+    for (size_t i = 0; i < n; ++i)
+      ++count[(entries_[i].key >> shift) & 0xFF];
+
+    if (count[(entries_[0].key >> shift) & 0xFF] == n) continue;   // Digit is the same for all keys
+
+    size_t offset = 0;
+    for (int d = 0; d < 256; ++d) {
+      size_t c = count[d];
+      count[d] = offset;
+      offset += c;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+      scratch_[count[(entries_[i].key >> shift) & 0xFF]++] = entries_[i];
+
+    entries_.swap(scratch_);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::ApplyViewport
+//|
+//! \param viewport    [in] Viewport id.
+//! \return None.
+//!
+//! Sets the viewport, the projection and loads the view transform.
+//|____________________________________________________________________
+
+void RenderQueue::ApplyViewport(int viewport)
+{
+  LoadViewport(viewports_[viewport]);
+
+  cur_viewport_ = viewport;
+  ++stats_.viewport_changes;
+  ++stats_.matrix_loads;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::ApplyColor
+//|
+//! \param col     [in] RGB color of the next vertex.
+//! \return None.
+//|____________________________________________________________________
+
+void RenderQueue::ApplyColor(const float* col)
+{
+  if (color_valid_ && col[0] == cur_color_[0] && col[1] == cur_color_[1] && col[2] == cur_color_[2]) return;
+
+  glColor3fv(col);
+
+  cur_color_[0] = col[0];
+  cur_color_[1] = col[1];
+  cur_color_[2] = col[2];
+  color_valid_ = true;
+  ++stats_.color_changes;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::Flush
+//|
+//! \param sorted  [in] Sort and batch the items (true) or draw them in
+//!                     submission order (false).
+//! \return None.
+//|____________________________________________________________________
+
+void RenderQueue::Flush(bool sorted)
+{
+  cur_viewport_ = -1;
+  color_valid_  = false;
+
+  if (!items_.empty()) {
+    if (sorted) FlushSorted();
+    else        FlushUnsorted();
+  }
+
+  items_.clear();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::FlushSorted
+//|
+//! \param None.
+//! \return None.
+//!
+//! Items are sorted by key, then consecutive items with the same viewport
+//! and pipeline state are merged into one glBegin/glEnd block. Vertices
+//! are transformed by the model matrix on the CPU so that the modelview
+//! matrix only has to be loaded once per viewport.
+//|____________________________________________________________________
+
+void RenderQueue::FlushSorted()
+{
+  entries_.resize(items_.size());
+
+  for (size_t i = 0; i < items_.size(); ++i) {
+    const DrawItem& item = items_[i];
+    const float*    v    = viewports_[item.viewport].view_mat.mData;
+    const float*    m    = item.model_mat.mData;
+
+    // View space z of the item's origin (third row of V^-1 times the translation of T)
+    float z = v[2] * m[12] + v[6] * m[13] + v[10] * m[14] + v[14];
+
+    entries_[i].key  = MakeKey(item, -z);
+    entries_[i].item = (unsigned int) i;
+  }
+
+  RadixSort();
+
+  int  cur_state = -1;
+  bool open      = false;
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const DrawItem&  item  = items_[entries_[i].item];
+    const MeshBatch& batch = meshes_[item.mesh].batches[item.batch];
+
+    if (item.viewport != cur_viewport_) {
+      if (open) { glEnd(); open = false; }
+      ApplyViewport(item.viewport);
+      cur_state = -1;
+    }
+
+    if (batch.state != cur_state) {
+      if (open) glEnd();
+      glBegin(STATE_MODES[batch.state]);
+      open      = true;
+      cur_state = batch.state;
+      ++stats_.pipeline_changes;
+      ++stats_.draw_calls;
+    }
+
+    const float* m = item.model_mat.mData;
+
+    for (size_t k = 0; k < batch.verts.size(); ++k) {
+      const MeshVertex& mv = batch.verts[k];
+      const float*      p  = mv.pos;
+
+      ApplyColor(mv.col);
+      glVertex3f(m[0] * p[0] + m[4] * p[1] + m[8]  * p[2] + m[12],
+                 m[1] * p[0] + m[5] * p[1] + m[9]  * p[2] + m[13],
+                 m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]);
+    }
+  }
+
+  if (open) glEnd();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: RenderQueue::FlushUnsorted
+//|
+//! \param None.
+//! \return None.
+//!
+//! Reference path: items in submission order, the modelview matrix is
+//! reloaded for every object and every batch gets its own glBegin/glEnd.
+//|____________________________________________________________________
+
+void RenderQueue::FlushUnsorted()
+{
+  int cur_state = -1;
+  const DrawItem* prev = 0;
+
+  for (size_t i = 0; i < items_.size(); ++i) {
+    const DrawItem&  item  = items_[i];
+    const MeshBatch& batch = meshes_[item.mesh].batches[item.batch];
+
+    if (item.viewport != cur_viewport_) {
+      ApplyViewport(item.viewport);
+      prev = 0;
+    }
+
+    if (!prev || prev->mesh != item.mesh || item.batch == 0) {
+      gmtl::Matrix44f modelview_mat = viewports_[item.viewport].view_mat * item.model_mat;   // M = V^-1 * T
+      glLoadMatrixf(modelview_mat.mData);
+      ++stats_.matrix_loads;
+    }
+
+    if (batch.state != cur_state) {
+      cur_state = batch.state;
+      ++stats_.pipeline_changes;
+    }
+
+    glBegin(STATE_MODES[batch.state]);
+    for (size_t k = 0; k < batch.verts.size(); ++k) {
+      ApplyColor(batch.verts[k].col);
+      glVertex3fv(batch.verts[k].pos);
+    }
+    glEnd();
+    ++stats_.draw_calls;
+
+    prev = &item;
+  }
+}
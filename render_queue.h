@@ -0,0 +1,181 @@
+//|___________________________________________________________________
+//!
+//! \file render_queue.h
+//!
+//! \brief State-sorted render queue.
+//!
+//! Geometry is recorded once into meshes (lists of batches, one per
+//! glBegin/glEnd block of the original drawing code). Every frame the
+//! scene submits draw items, each carrying a 64-bit sort key:
+//!
+//!   bits 56..63  viewport
+//!   bits 48..55  pipeline state (primitive type)
+//!   bits 32..47  mesh
+//!   bits  0..31  depth (view space distance, front to back)
+//!
+//! The items are radix-sorted before submission so that draws sharing the
+//! same viewport and pipeline state end up in a single glBegin/glEnd block.
+//|___________________________________________________________________
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <vector>
+
+#include <gmtl/gmtl.h>
+
+#include <GL/glut.h>
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+// Pipeline states known to the queue. Polygons and quads are triangulated
+// when the mesh is recorded, so only two primitive types remain.
+enum PipelineState
+{
+  PS_LINES     = 0,
+  PS_TRIANGLES = 1,
+  PS_COUNT
+};
+
+struct MeshVertex
+{
+  float pos[3];
+  float col[3];
+};
+
+// One batch = the vertices of one original glBegin/glEnd block
+struct MeshBatch
+{
+  PipelineState           state;
+  std::vector<MeshVertex> verts;
+};
+
+struct Mesh
+{
+  std::vector<MeshBatch> batches;
+};
+
+// Viewport rectangle, projection and view transform (M = V^-1 part)
+struct Viewport
+{
+  GLint           x, y;
+  GLsizei         width, height;
+  float           fov, aspect, z_near, z_far;
+  gmtl::Matrix44f view_mat;
+};
+
+// Per-frame counters, reset by RenderQueue::BeginFrame(). Geometry drawn
+// outside the queue (terrain) adds its own GL work to a copy of them.
+struct RenderStats
+{
+  int items;               // Draw items submitted (one per mesh batch)
+  int draw_calls;          // glBegin/glEnd blocks and glDraw* calls issued
+  int viewport_changes;    // glViewport + projection setups
+  int pipeline_changes;    // Primitive type / vertex array setup switches
+  int matrix_loads;        // glLoadMatrixf calls
+  int color_changes;       // glColor calls that changed the current color
+
+  int StateChanges() const { return viewport_changes + pipeline_changes + matrix_loads + color_changes; }
+};
+
+//! Sets the viewport rectangle and projection, and loads the view
+//! transform as the modelview matrix.
+void LoadViewport(const Viewport& viewport);
+
+//|____________________________________________________________________
+//|
+//| Class: MeshBuilder
+//|
+//! Records immediate-mode style calls (Begin/Color3f/Vertex3f/End) into a
+//! mesh, so existing drawing code can be turned into static geometry with
+//! minimal changes. GL_POLYGON and GL_QUADS are triangulated on End().
+//|____________________________________________________________________
+
+class MeshBuilder
+{
+public:
+  explicit MeshBuilder(Mesh& mesh);
+
+  void Begin(GLenum mode);
+  void Color3f(float r, float g, float b);
+  void Vertex3f(float x, float y, float z);
+  void End();
+
+private:
+  Mesh&                   mesh_;
+  GLenum                  mode_;
+  bool                    open_;
+  float                   color_[3];
+  std::vector<MeshVertex> verts_;
+};
+
+//|____________________________________________________________________
+//|
+//| Class: RenderQueue
+//|
+//! Collects draw items for a frame, sorts them by key and submits them
+//! with redundant GL state changes removed.
+//|____________________________________________________________________
+
+class RenderQueue
+{
+public:
+  RenderQueue();
+
+  int  AddMesh(const Mesh& mesh);               // Returns the mesh id
+
+  void BeginFrame();
+  int  AddViewport(const Viewport& viewport);   // Returns the viewport id (valid for this frame)
+  void Submit(int viewport, int mesh, const gmtl::Matrix44f& model_mat);
+
+  //! Draws all submitted items. When sorted is false, items are drawn in
+  //! submission order with one glBegin/glEnd per batch, i.e. the way the
+  //! scene used to be drawn, which is useful for comparing the counters.
+  void Flush(bool sorted);
+
+  const RenderStats& Stats() const { return stats_; }
+
+private:
+  struct DrawItem
+  {
+    int             viewport;
+    int             mesh;
+    int             batch;
+    gmtl::Matrix44f model_mat;
+  };
+
+  struct SortEntry
+  {
+    unsigned long long key;
+    unsigned int       item;
+  };
+
+  unsigned long long MakeKey(const DrawItem& item, float depth) const;
+  void RadixSort();
+  void ApplyViewport(int viewport);
+  void ApplyColor(const float* col);
+
+  void FlushSorted();
+  void FlushUnsorted();
+
+  std::vector<Mesh>      meshes_;
+  std::vector<Viewport>  viewports_;
+  std::vector<DrawItem>  items_;
+  std::vector<SortEntry> entries_;
+  std::vector<SortEntry> scratch_;
+
+  int         cur_viewport_;
+  float       cur_color_[3];
+  bool        color_valid_;
+  RenderStats stats_;
+};
+
+#endif // RENDER_QUEUE_H
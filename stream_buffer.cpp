@@ -0,0 +1,447 @@
+//|___________________________________________________________________
+//!
+//! \file stream_buffer.cpp
+//!
+//! \brief Ring buffer for geometry appended by the CPU and kept on the GPU.
+//!
+//! The buffer object entry points are newer than the GL 1.1 headers
+//! shipped on Windows, so they are looked up at run time.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "stream_buffer.h"
+
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER                 0x8892
+#endif
+#ifndef GL_DYNAMIC_DRAW
+#define GL_DYNAMIC_DRAW                 0x88E8
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT                0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT     0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT       0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT           0x0040
+#define GL_MAP_COHERENT_BIT             0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE   0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT      0x00000001
+#define GL_TIMEOUT_EXPIRED              0x911B
+#define GL_WAIT_FAILED                  0x911D
+#endif
+
+const size_t             ALIGNMENT    = 16;
+const unsigned long long WAIT_TIMEOUT = 1000000;      // ns per wait, i.e. 1 ms
+
+//|___________________
+//|
+//| GL entry points
+//|___________________
+
+typedef void      (APIENTRY *GenBuffersFunc)    (GLsizei n, GLuint* buffers);
+typedef void      (APIENTRY *DeleteBuffersFunc) (GLsizei n, const GLuint* buffers);
+typedef void      (APIENTRY *BindBufferFunc)    (GLenum target, GLuint buffer);
+typedef void      (APIENTRY *BufferDataFunc)    (GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void      (APIENTRY *BufferSubDataFunc) (GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data);
+typedef void      (APIENTRY *BufferStorageFunc) (GLenum target, ptrdiff_t size, const void* data, GLbitfield flags);
+typedef void*     (APIENTRY *MapBufferRangeFunc)(GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+typedef GLboolean (APIENTRY *UnmapBufferFunc)   (GLenum target);
+typedef void*     (APIENTRY *FenceSyncFunc)     (GLenum condition, GLbitfield flags);
+typedef GLenum    (APIENTRY *ClientWaitSyncFunc)(void* sync, GLbitfield flags, unsigned long long timeout);
+typedef void      (APIENTRY *DeleteSyncFunc)    (void* sync);
+
+static GenBuffersFunc     GenBuffers;
+static DeleteBuffersFunc  DeleteBuffers;
+static BindBufferFunc     BindBuffer;
+static BufferDataFunc     BufferData;
+static BufferSubDataFunc  BufferSubData;
+static BufferStorageFunc  BufferStorage;
+static MapBufferRangeFunc MapBufferRange;
+static UnmapBufferFunc    UnmapBuffer;
+static FenceSyncFunc      FenceSync;
+static ClientWaitSyncFunc ClientWaitSync;
+static DeleteSyncFunc     DeleteSync;
+
+//|____________________________________________________________________
+//|
+//| Function: GetProc
+//|
+//! \param name    [in] GL function name.
+//! \return Entry point, or null if not available.
+//|____________________________________________________________________
+
+static void* GetProc(const char* name)
+{
+#ifdef _WIN32
+  void* p = (void*) wglGetProcAddress(name);
+  if (p == (void*) 1 || p == (void*) 2 || p == (void*) 3 || p == (void*) -1) p = 0;   // Some drivers return these on failure
+  return p;
+#else
+  return (void*) glXGetProcAddressARB((const GLubyte*) name);
+#endif
+}
+
+//|____________________________________________________________________
+//|
+//| Function: HasGL
+//|
+//! \param major,minor     [in] Core version that has the feature.
+//! \param extension       [in] Extension that has the feature, or null.
+//! \return True if the current context has the feature.
+//|____________________________________________________________________
+
+static bool HasGL(int major, int minor, const char* extension)
+{
+  const char* version = (const char*) glGetString(GL_VERSION);
+  int v_major = 0, v_minor = 0;
+
+  if (version && sscanf(version, "%d.%d", &v_major, &v_minor) == 2 &&
+      (v_major > major || (v_major == major && v_minor >= minor))) return true;
+
+  const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+  return extension && extensions && strstr(extensions, extension);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::StreamBuffer
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+StreamBuffer::StreamBuffer()
+  : mode_(MODE_NONE), size_(0), buffer_(0), mapped_(0), head_(0), unfenced_(0),
+    pending_offset_(0), pending_bytes_(0), pending_mapped_(false)
+{
+  stats_ = StreamStats();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Init
+//|
+//! \param bytes   [in] Buffer size.
+//! \return True on success.
+//|____________________________________________________________________
+
+bool StreamBuffer::Init(size_t bytes)
+{
+  size_ = bytes - bytes % ALIGNMENT;
+
+  GenBuffers     = (GenBuffersFunc)     GetProc("glGenBuffers");
+  DeleteBuffers  = (DeleteBuffersFunc)  GetProc("glDeleteBuffers");
+  BindBuffer     = (BindBufferFunc)     GetProc("glBindBuffer");
+  BufferData     = (BufferDataFunc)     GetProc("glBufferData");
+  BufferSubData  = (BufferSubDataFunc)  GetProc("glBufferSubData");
+  BufferStorage  = (BufferStorageFunc)  GetProc("glBufferStorage");
+  MapBufferRange = (MapBufferRangeFunc) GetProc("glMapBufferRange");
+  UnmapBuffer    = (UnmapBufferFunc)    GetProc("glUnmapBuffer");
+  FenceSync      = (FenceSyncFunc)      GetProc("glFenceSync");
+  ClientWaitSync = (ClientWaitSyncFunc) GetProc("glClientWaitSync");
+  DeleteSync     = (DeleteSyncFunc)     GetProc("glDeleteSync");
+
+  bool buffers    = HasGL(1, 5, 0) && GenBuffers && DeleteBuffers && BindBuffer && BufferData && BufferSubData;
+  bool map_range  = HasGL(3, 0, "GL_ARB_map_buffer_range") && MapBufferRange && UnmapBuffer;
+  bool sync       = HasGL(3, 2, "GL_ARB_sync") && FenceSync && ClientWaitSync && DeleteSync;
+  bool storage    = HasGL(4, 4, "GL_ARB_buffer_storage") && BufferStorage;
+
+  if (buffers && map_range && sync && storage) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    GenBuffers(1, &buffer_);
+    BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    BufferStorage(GL_ARRAY_BUFFER, (ptrdiff_t) size_, 0, flags);
+    mapped_ = (unsigned char*) MapBufferRange(GL_ARRAY_BUFFER, 0, (ptrdiff_t) size_, flags);
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mapped_) {
+      mode_ = MODE_PERSISTENT;
+      return true;
+    }
+
+    DeleteBuffers(1, &buffer_);               // Immutable storage, can't be used any other way
+    buffer_ = 0;
+  }
+
+  if (buffers) {
+    GenBuffers(1, &buffer_);
+    BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    BufferData(GL_ARRAY_BUFFER, (ptrdiff_t) size_, 0, GL_DYNAMIC_DRAW);
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    client_.resize(size_);                    // Staging for glBufferSubData (also if a map fails)
+
+    mode_ = (map_range && sync) ? MODE_MAPPED : MODE_SUBDATA;
+    return true;
+  }
+
+  buffer_ = 0;
+  client_.resize(size_);
+  mode_ = MODE_CLIENT;
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::GetMode / ModeName
+//|____________________________________________________________________
+
+StreamBuffer::Mode StreamBuffer::GetMode() const
+{
+  return mode_;
+}
+
+const char* StreamBuffer::ModeName() const
+{
+  switch (mode_) {
+    case MODE_PERSISTENT: return "persistent";
+    case MODE_MAPPED:     return "mapped";
+    case MODE_SUBDATA:    return "subdata";
+    case MODE_CLIENT:     return "client";
+    default:              return "none";
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::BeginFrame
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+void StreamBuffer::BeginFrame()
+{
+  stats_.bytes = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::EndFrame
+//|
+//! \param None.
+//! \return None.
+//!
+//! Call after the draws of the frame. Ranges released this frame were
+//! still read by these draws, so their fence goes after them.
+//|____________________________________________________________________
+
+void StreamBuffer::EndFrame()
+{
+  if (!unfenced_) return;
+
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    Range& r = ranges_[i];
+    if (r.released && !r.fence) r.fence = FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  unfenced_ = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Overlaps
+//|
+//! \param offset  [in] Start of the space.
+//! \param bytes   [in] Size of the space.
+//! \return True if the space overlaps an allocated range.
+//|____________________________________________________________________
+
+bool StreamBuffer::Overlaps(size_t offset, size_t bytes) const
+{
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    const Range& r = ranges_[i];
+    if (r.offset < offset + bytes && offset < r.offset + r.bytes) return true;
+  }
+  return false;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Wait
+//|
+//! \param fence   [in] Fence of a released range, deleted once passed.
+//! \return None.
+//!
+//! Normally the GPU passed the fence long ago and this doesn't block.
+//|____________________________________________________________________
+
+void StreamBuffer::Wait(void* fence)
+{
+  if (ClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    GLenum r;
+    do r = ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+    while (r == GL_TIMEOUT_EXPIRED);
+
+    stats_.stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ++stats_.stalls;
+  }
+
+  DeleteSync(fence);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Allocate
+//|
+//! \param bytes   [in]  Size of the data to write.
+//! \param offset  [out] Offset of the data, for Pointer().
+//! \return Write pointer, or null if there is no room.
+//!
+//! The oldest ranges are reclaimed until the new one fits: released ones
+//! once the GPU passed their fence, ranges still in use never.
+//|____________________________________________________________________
+
+void* StreamBuffer::Allocate(size_t bytes, size_t& offset)
+{
+  if (mode_ == MODE_NONE || bytes == 0 || bytes > size_) {
+    ++stats_.overflows;
+    return 0;
+  }
+
+  size_t start = (head_ + bytes <= size_) ? head_ : 0;
+
+  while (Overlaps(start, bytes)) {
+    Range& r = ranges_.front();
+
+    // Still drawn, or released this frame and not fenced yet
+    if (!r.released || (Fenced() && !r.fence)) {
+      ++stats_.overflows;
+      return 0;
+    }
+
+    if (r.fence) Wait(r.fence);
+    ranges_.pop_front();
+  }
+
+  Range range = { start, bytes, false, 0 };
+  ranges_.push_back(range);
+
+  offset = start;
+  head_  = (start + bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  stats_.bytes += bytes;
+
+  switch (mode_) {
+    case MODE_PERSISTENT:
+      return mapped_ + offset;
+
+    case MODE_MAPPED: {
+      pending_offset_ = offset;
+      pending_bytes_  = bytes;
+
+      // The fences guarantee the GPU is done with this range
+      BindBuffer(GL_ARRAY_BUFFER, buffer_);
+      void* p = MapBufferRange(GL_ARRAY_BUFFER, (ptrdiff_t) offset, (ptrdiff_t) bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+      BindBuffer(GL_ARRAY_BUFFER, 0);
+
+      // Map failed: nothing to unmap, Commit() copies the staging instead
+      pending_mapped_ = (p != 0);
+      return p ? p : &client_[offset];
+    }
+
+    case MODE_SUBDATA:
+      pending_offset_ = offset;
+      pending_bytes_  = bytes;
+      pending_mapped_ = false;
+      return &client_[offset];
+
+    default:
+      return &client_[offset];
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Commit
+//|
+//! \param None.
+//! \return None.
+//!
+//! Makes the last allocation visible to GL. Nothing to do for coherent
+//! persistent mappings and client arrays.
+//|____________________________________________________________________
+
+void StreamBuffer::Commit()
+{
+  if (!pending_bytes_) return;
+
+  BindBuffer(GL_ARRAY_BUFFER, buffer_);
+
+  if (pending_mapped_) UnmapBuffer(GL_ARRAY_BUFFER);
+  else                 BufferSubData(GL_ARRAY_BUFFER, (ptrdiff_t) pending_offset_, (ptrdiff_t) pending_bytes_, &client_[pending_offset_]);
+
+  BindBuffer(GL_ARRAY_BUFFER, 0);
+
+  pending_bytes_  = 0;
+  pending_mapped_ = false;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Release
+//|
+//! \param offset  [in] Offset returned by Allocate().
+//! \return None.
+//|____________________________________________________________________
+
+void StreamBuffer::Release(size_t offset)
+{
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    Range& r = ranges_[i];
+
+    if (r.offset == offset && !r.released) {
+      r.released = true;
+      if (Fenced()) ++unfenced_;
+      return;
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StreamBuffer::Bind / Unbind / Pointer
+//|____________________________________________________________________
+
+void StreamBuffer::Bind() const
+{
+  if (buffer_) BindBuffer(GL_ARRAY_BUFFER, buffer_);
+}
+
+void StreamBuffer::Unbind() const
+{
+  if (buffer_) BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+const void* StreamBuffer::Pointer(size_t offset) const
+{
+  if (buffer_) return (const void*) offset;    // Offset into the bound buffer
+  return &client_[0] + offset;
+}
@@ -0,0 +1,126 @@
+//|___________________________________________________________________
+//!
+//! \file stream_buffer.h
+//!
+//! \brief Ring buffer for geometry appended by the CPU and kept on the GPU.
+//!
+//! Data is appended at the head of the ring and stays there, drawable,
+//! until the caller releases it. Released ranges are fenced after the
+//! frame's draws, and the head only overwrites a range once the GPU has
+//! passed its fence. The best path available on the GL implementation is
+//! picked at Init():
+//!
+//!   MODE_PERSISTENT  GL 4.4 / ARB_buffer_storage: the buffer is mapped
+//!                    once (persistent + coherent), appends are written
+//!                    straight into it.
+//!   MODE_MAPPED      GL 3.2 (map_buffer_range + sync): each append maps
+//!                    its range unsynchronized, the fences make it safe.
+//!   MODE_SUBDATA     GL 1.5 buffer objects: appends are staged and copied
+//!                    with glBufferSubData, the driver synchronizes.
+//!   MODE_CLIENT      No buffer objects: plain client-side vertex arrays.
+//|___________________________________________________________________
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <stddef.h>
+
+#include <deque>
+#include <vector>
+
+#include <GL/glut.h>
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+struct StreamStats
+{
+  size_t bytes;          // Appended this frame
+  int    stalls;         // Total appends the CPU had to wait for a fence
+  double stall_ms;       // Total time spent waiting
+  int    overflows;      // Total appends that didn't fit
+};
+
+//|____________________________________________________________________
+//|
+//| Class: StreamBuffer
+//|____________________________________________________________________
+
+class StreamBuffer
+{
+public:
+  enum Mode { MODE_NONE, MODE_CLIENT, MODE_SUBDATA, MODE_MAPPED, MODE_PERSISTENT };
+
+  StreamBuffer();
+
+  //! Creates the buffer, needs a current GL context. The buffer lives as
+  //! long as the context.
+  bool Init(size_t bytes);
+
+  Mode        GetMode() const;
+  const char* ModeName() const;
+
+  void BeginFrame();                  // Resets the per-frame counters
+  void EndFrame();                    // Fences the ranges released this frame, after its draws
+
+  //! Appends bytes at the head of the ring (wrapping to the start when
+  //! the end is too short). Returns where to write them and their offset
+  //! for Pointer(), or null if that space is still in use. Commit() once
+  //! written. Offsets are 16-byte aligned.
+  void* Allocate(size_t bytes, size_t& offset);
+  void  Commit();
+
+  //! The range allocated at offset won't be drawn after this frame; its
+  //! space is reused once the GPU is done with it.
+  void  Release(size_t offset);
+
+  //! Binds the buffer for gl*Pointer calls; Pointer() turns an offset into
+  //! the pointer argument to pass.
+  void        Bind() const;
+  void        Unbind() const;
+  const void* Pointer(size_t offset) const;
+
+  const StreamStats& Stats() const { return stats_; }
+
+private:
+  StreamBuffer(const StreamBuffer&);            // Not copyable
+  StreamBuffer& operator=(const StreamBuffer&);
+
+  struct Range
+  {
+    size_t offset, bytes;
+    bool   released;
+    void*  fence;                // Placed by the EndFrame() after the release (fenced modes)
+  };
+
+  bool Fenced() const { return mode_ == MODE_PERSISTENT || mode_ == MODE_MAPPED; }
+  bool Overlaps(size_t offset, size_t bytes) const;
+  void Wait(void* fence);
+
+  Mode                 mode_;
+  size_t               size_;
+  GLuint               buffer_;
+  unsigned char*       mapped_;          // Persistent mapping
+  std::vector<unsigned char> client_;    // Client arrays / glBufferSubData staging
+
+  // Ring state: allocated ranges, oldest first
+  std::deque<Range>    ranges_;
+  size_t               head_;            // Next free byte
+  int                  unfenced_;        // Released ranges waiting for EndFrame()
+
+  // Pending allocation (mapped/subdata modes)
+  size_t               pending_offset_;
+  size_t               pending_bytes_;
+  bool                 pending_mapped_;
+
+  StreamStats          stats_;
+};
+
+#endif // STREAM_BUFFER_H
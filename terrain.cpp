@@ -0,0 +1,745 @@
+//|___________________________________________________________________
+//!
+//! \file terrain.cpp
+//!
+//! \brief Streaming tiled terrain implementation.
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+#include "terrain.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float LOD_FACTOR = 2.0f;       // Tiles closer than LOD_FACTOR * tile size are split into their children
+const int   TILE_VERTS = Terrain::TILE_CELLS + 1;
+
+//|____________________________________________________________________
+//|
+//| Function: NowMs
+//|
+//! \param None.
+//! \return Monotonic time in ms.
+//|____________________________________________________________________
+
+static double NowMs()
+{
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Noise
+//|
+//! \param x,z     [in] Lattice coordinates.
+//! \return Smoothly interpolated value noise in [0,1].
+//|____________________________________________________________________
+
+static float Lattice(int x, int z)
+{
+  unsigned int h = (unsigned int) x * 374761393u + (unsigned int) z * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  return (float) ((h ^ (h >> 16)) & 0xFFFF) / 65535.0f;
+}
+
+static float Noise(float x, float z)
+{
+  int   ix = (int) floorf(x), iz = (int) floorf(z);
+  float fx = x - ix,          fz = z - iz;
+
+  fx = fx * fx * (3 - 2 * fx);
+  fz = fz * fz * (3 - 2 * fz);
+
+  float a = Lattice(ix, iz)     + (Lattice(ix + 1, iz)     - Lattice(ix, iz))     * fx;
+  float b = Lattice(ix, iz + 1) + (Lattice(ix + 1, iz + 1) - Lattice(ix, iz + 1)) * fx;
+  return a + (b - a) * fz;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Terrain
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+Terrain::Terrain()
+  : size_(0), cell_size_(1.0f), height_scale_(1.0f), base_height_(0.0f), origin_(0.0f),
+    levels_(0), budget_bytes_(0), frame_(0), loading_(0), busy_(false), quit_(false),
+    latency_sum_ms_(0.0), latency_samples_(0)
+{
+  stats_ = TerrainStats();
+}
+
+Terrain::~Terrain()
+{
+  Close();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::CreateHeightmap
+//|
+//! \param path            [in] File to write.
+//! \param size            [in] Samples per side, TILE_CELLS * 2^n + 1.
+//! \param cell_size       [in] World units between samples.
+//! \param height_scale    [in] World height of the highest sample value.
+//! \return True on success.
+//!
+//! Fractal value noise, written one row at a time so the map never has to
+//! fit in memory.
+//|____________________________________________________________________
+
+bool Terrain::CreateHeightmap(const char* path, unsigned int size, float cell_size, float height_scale)
+{
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+
+  HeightmapHeader header;
+  memcpy(header.magic, "HMAP", 4);
+  header.size         = size;
+  header.cell_size    = cell_size;
+  header.height_scale = height_scale;
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+  std::vector<unsigned short> row(size);
+
+  for (unsigned int z = 0; ok && z < size; ++z) {
+    for (unsigned int x = 0; x < size; ++x) {
+      float h = 0.0f, amp = 0.5f, freq = 1.0f / 512.0f;
+
+      for (int octave = 0; octave < 6; ++octave) {
+        h    += amp * Noise(x * freq, z * freq);
+        amp  *= 0.5f;
+        freq *= 2.0f;
+      }
+
+      h = h / 0.984375f;                       // Sum of the octave amplitudes
+      row[x] = (unsigned short) (std::min(h * h, 1.0f) * 65535.0f);   // Squared: flat valleys, steep peaks
+    }
+    ok = fwrite(&row[0], sizeof(unsigned short), size, f) == size;
+  }
+
+  return fclose(f) == 0 && ok;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Open
+//|
+//! \param path            [in] Heightmap file.
+//! \param base_height     [in] World height of sample value 0.
+//! \param budget_bytes    [in] Memory budget of the resident tiles.
+//! \return True on success.
+//|____________________________________________________________________
+
+bool Terrain::Open(const char* path, float base_height, size_t budget_bytes)
+{
+  Close();
+
+  if (!file_.Open(path)) return false;
+
+  HeightmapHeader header;
+  {
+    MappedView view;
+    if (!view.Map(file_, 0, sizeof(header))) { file_.Close(); return false; }
+    memcpy(&header, view.Data(), sizeof(header));
+  }
+
+  // size - 1 must be TILE_CELLS * 2^n, and all samples must be present
+  unsigned int tiles = (header.size - 1) / TILE_CELLS;
+  if (memcmp(header.magic, "HMAP", 4) != 0 || header.size < (unsigned int) TILE_VERTS ||
+      tiles * TILE_CELLS != header.size - 1 || (tiles & (tiles - 1)) != 0 ||
+      file_.Size() < sizeof(header) + (unsigned long long) header.size * header.size * sizeof(unsigned short)) {
+    file_.Close();
+    return false;
+  }
+
+  size_         = header.size;
+  cell_size_    = header.cell_size;
+  height_scale_ = header.height_scale;
+  base_height_  = base_height;
+  origin_       = -0.5f * (size_ - 1) * cell_size_;
+  budget_bytes_ = budget_bytes;
+
+  levels_ = 1;
+  while ((1u << (levels_ - 1)) < tiles) ++levels_;
+
+  BuildIndices();
+
+  stats_ = TerrainStats();
+  stats_.budget_bytes = budget_bytes_;
+  latency_sum_ms_     = 0.0;
+  latency_samples_    = 0;
+
+  quit_      = false;
+  busy_      = false;
+  io_thread_ = std::thread(&Terrain::IoThread, this);
+
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Close
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+void Terrain::Close()
+{
+  if (io_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    cond_.notify_all();
+    io_thread_.join();
+  }
+
+  queue_.clear();
+  done_.clear();
+  tiles_.clear();
+  lru_.clear();
+  requests_.clear();
+  request_time_.clear();
+
+  file_.Close();
+  levels_ = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::MakeKey / SplitKey
+//|
+//! Tile keys pack (level, x, z) into 64 bits.
+//|____________________________________________________________________
+
+Terrain::TileKey Terrain::MakeKey(int level, int x, int z)
+{
+  return ((TileKey) level << 48) | ((TileKey) x << 24) | (TileKey) z;
+}
+
+void Terrain::SplitKey(TileKey key, int& level, int& x, int& z)
+{
+  level = (int) (key >> 48);
+  x     = (int) ((key >> 24) & 0xFFFFFF);
+  z     = (int) (key & 0xFFFFFF);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::BuildIndices
+//|
+//! \param None.
+//! \return None.
+//!
+//! Triangles of the tile grid, plus the skirts hanging down from the four
+//! edges that hide cracks between tiles of different levels.
+//|____________________________________________________________________
+
+void Terrain::BuildIndices()
+{
+  indices_.clear();
+
+  for (int j = 0; j < TILE_CELLS; ++j) {
+    for (int i = 0; i < TILE_CELLS; ++i) {
+      GLushort a = (GLushort) (j * TILE_VERTS + i);
+      GLushort b = (GLushort) (a + 1);
+      GLushort c = (GLushort) (a + TILE_VERTS);
+      GLushort d = (GLushort) (c + 1);
+
+      indices_.push_back(a); indices_.push_back(c); indices_.push_back(b);
+      indices_.push_back(b); indices_.push_back(c); indices_.push_back(d);
+    }
+  }
+
+  // Skirt vertices follow the grid: edges z = 0, z = max, x = 0, x = max
+  const int skirt = TILE_VERTS * TILE_VERTS;
+
+  for (int e = 0; e < 4; ++e) {
+    for (int k = 0; k < TILE_CELLS; ++k) {
+      int g0, g1;
+      switch (e) {
+        case 0:  g0 = k;                                   g1 = k + 1;                                 break;
+        case 1:  g0 = TILE_CELLS * TILE_VERTS + k;         g1 = g0 + 1;                                break;
+        case 2:  g0 = k * TILE_VERTS;                      g1 = (k + 1) * TILE_VERTS;                  break;
+        default: g0 = k * TILE_VERTS + TILE_CELLS;         g1 = (k + 1) * TILE_VERTS + TILE_CELLS;     break;
+      }
+
+      GLushort a  = (GLushort) g0;
+      GLushort b  = (GLushort) g1;
+      GLushort sa = (GLushort) (skirt + e * TILE_VERTS + k);
+      GLushort sb = (GLushort) (sa + 1);
+
+      indices_.push_back(a); indices_.push_back(b);  indices_.push_back(sb);
+      indices_.push_back(a); indices_.push_back(sb); indices_.push_back(sa);
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::MapRows
+//|
+//! \param sx0,sz0     [in]  First sample of the tile.
+//! \param stride      [in]  Samples between two tile vertices.
+//! \param rows        [out] Mapped rows.
+//! \return None.
+//!
+//! Full resolution tiles read consecutive rows, mapped as one band;
+//! coarser tiles map each row they read. Either way only the columns of
+//! the tile are needed. Rows that fail to map are left null.
+//|____________________________________________________________________
+
+void Terrain::MapRows(int sx0, int sz0, int stride, TileRows& rows) const
+{
+  const int max  = (int) size_ - 1;
+  const int x_lo = std::max(0, sx0 - stride);
+  const int x_hi = std::min(max, sx0 + (TILE_CELLS + 1) * stride);
+  const int n    = TILE_CELLS + 3;
+
+  rows.sz0    = sz0;
+  rows.stride = stride;
+  rows.x_lo   = x_lo;
+
+  int sz[TILE_CELLS + 3];
+  for (int k = 0; k < n; ++k) sz[k] = std::max(0, std::min(sz0 + (k - 1) * stride, max));
+
+  // Byte offset of sample (x, z) in the file
+  const unsigned long long size = size_;
+  auto offset = [size](int x, int z) {
+    return sizeof(HeightmapHeader) + (z * size + x) * sizeof(unsigned short);
+  };
+
+  if (stride == 1) {
+    unsigned long long begin = offset(x_lo, sz[0]);
+    unsigned long long end   = offset(x_hi, sz[n - 1]) + sizeof(unsigned short);
+    bool               ok    = rows.views[0].Map(file_, begin, (size_t) (end - begin));
+
+    for (int k = 0; k < n; ++k)
+      rows.rows[k] = ok ? (const unsigned short*) (rows.views[0].Data() + (offset(x_lo, sz[k]) - begin)) : 0;
+  }
+  else {
+    for (int k = 0; k < n; ++k) {
+      bool ok = rows.views[k].Map(file_, offset(x_lo, sz[k]), (x_hi - x_lo + 1) * sizeof(unsigned short));
+      rows.rows[k] = ok ? (const unsigned short*) rows.views[k].Data() : 0;
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Height
+//|
+//! \param rows    [in] Rows mapped for the tile.
+//! \param sx,sz   [in] Sample coordinates on the tile's grid (or one cell
+//!                     around it), clamped to the map.
+//! \return World height of the sample, base height if it couldn't be mapped.
+//|____________________________________________________________________
+
+float Terrain::Height(const TileRows& rows, int sx, int sz) const
+{
+  const unsigned short* row = rows.rows[(sz - rows.sz0) / rows.stride + 1];
+  if (!row) return base_height_;
+
+  int max = (int) size_ - 1;
+  sx = std::max(0, std::min(sx, max));
+
+  return base_height_ + row[sx - rows.x_lo] * (height_scale_ / 65535.0f);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::BuildTile
+//|
+//! \param key     [in]  Tile to build.
+//! \param verts   [out] Grid and skirt vertices, in world coordinates.
+//! \return None.
+//!
+//! Runs on the I/O thread: this is where the tile's rows are mapped and
+//! read (and paged in by the OS).
+//|____________________________________________________________________
+
+void Terrain::BuildTile(TileKey key, std::vector<TerrainVertex>& verts) const
+{
+  int level, tx, tz;
+  SplitKey(key, level, tx, tz);
+
+  const int stride = 1 << level;
+  const int sx0    = tx * TILE_CELLS * stride;
+  const int sz0    = tz * TILE_CELLS * stride;
+
+  TileRows rows;
+  MapRows(sx0, sz0, stride, rows);
+
+  verts.resize(TILE_VERTS * TILE_VERTS + 4 * TILE_VERTS);
+
+  for (int j = 0; j < TILE_VERTS; ++j) {
+    for (int i = 0; i < TILE_VERTS; ++i) {
+      int   sx = sx0 + i * stride;
+      int   sz = sz0 + j * stride;
+      float h  = Height(rows, sx, sz);
+
+      // Color by height, darkened on slopes facing away from +x/+z
+      float t     = (h - base_height_) / height_scale_;
+      float slope = (Height(rows, sx - stride, sz) - Height(rows, sx + stride, sz) +
+                     Height(rows, sx, sz - stride) - Height(rows, sx, sz + stride)) / (2 * stride * cell_size_);
+      float shade = std::max(0.5f, std::min(0.85f + 0.5f * slope, 1.15f));
+
+      float r, g, b;
+      if (t < 0.3f)      { r = 0.25f; g = 0.45f; b = 0.20f; }   // Grass
+      else if (t < 0.7f) { r = 0.45f; g = 0.38f; b = 0.25f; }   // Rock
+      else               { r = 0.90f; g = 0.90f; b = 0.92f; }   // Snow
+
+      TerrainVertex& v = verts[j * TILE_VERTS + i];
+      v.pos[0] = origin_ + sx * cell_size_;
+      v.pos[1] = h;
+      v.pos[2] = origin_ + sz * cell_size_;
+      v.col[0] = (unsigned char) std::min(255.0f, r * shade * 255.0f);
+      v.col[1] = (unsigned char) std::min(255.0f, g * shade * 255.0f);
+      v.col[2] = (unsigned char) std::min(255.0f, b * shade * 255.0f);
+      v.col[3] = 255;
+    }
+  }
+
+  // Skirts: copies of the edge vertices, lowered by one (level) cell
+  const float drop  = stride * cell_size_;
+  const int   skirt = TILE_VERTS * TILE_VERTS;
+
+  for (int k = 0; k < TILE_VERTS; ++k) {
+    int edge[4] = { k, TILE_CELLS * TILE_VERTS + k, k * TILE_VERTS, k * TILE_VERTS + TILE_CELLS };
+
+    for (int e = 0; e < 4; ++e) {
+      TerrainVertex& v = verts[skirt + e * TILE_VERTS + k];
+      v = verts[edge[e]];
+      v.pos[1] -= drop;
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Distance
+//|
+//! \param level,x,z   [in] Tile.
+//! \param eye         [in] Camera position in world coordinates.
+//! \return Distance from the camera to the tile's bounding box.
+//|____________________________________________________________________
+
+float Terrain::Distance(int level, int x, int z, const float* eye) const
+{
+  float size = (float) (TILE_CELLS << level) * cell_size_;
+  float x0   = origin_ + x * size;
+  float z0   = origin_ + z * size;
+
+  float dx = std::max(0.0f, std::max(x0 - eye[0], eye[0] - (x0 + size)));
+  float dy = std::max(0.0f, std::max(base_height_ - eye[1], eye[1] - (base_height_ + height_scale_)));
+  float dz = std::max(0.0f, std::max(z0 - eye[2], eye[2] - (z0 + size)));
+
+  return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Use
+//|
+//! \param key         [in] Tile.
+//! \param priority    [in] Load priority if missing (lower loads first).
+//! \return The resident tile, or null after requesting it.
+//|____________________________________________________________________
+
+const Terrain::Tile* Terrain::Use(TileKey key, float priority)
+{
+  std::map<TileKey, Tile>::iterator it = tiles_.find(key);
+
+  if (it == tiles_.end()) {
+    requests_.push_back(std::make_pair(priority, key));
+    request_time_.insert(std::make_pair(key, NowMs()));     // Keeps the first request time
+    return 0;
+  }
+
+  Tile& tile = it->second;
+  tile.last_frame = frame_;
+  lru_.splice(lru_.begin(), lru_, tile.lru);
+  return &tile;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Select
+//|
+//! \param level,x,z   [in]  Tile.
+//! \param eye         [in]  Camera position in world coordinates.
+//! \param z_far       [in]  Tiles further away are skipped.
+//! \param draw        [out] Tiles to draw.
+//! \return None.
+//!
+//! A tile close enough to the camera is replaced by its four children,
+//! but only once all of them are resident; until then the tile itself is
+//! drawn while the children stream in.
+//|____________________________________________________________________
+
+void Terrain::Select(int level, int x, int z, const float* eye, float z_far, std::vector<const Tile*>& draw)
+{
+  float d = Distance(level, x, z, eye);
+  if (d > z_far) return;
+
+  // Coarse tiles first, then nearest
+  const Tile* tile = Use(MakeKey(level, x, z), (levels_ - level) * 1.0e6f + d);
+
+  if (level > 0 && d < LOD_FACTOR * (TILE_CELLS << level) * cell_size_) {
+    bool ready = true;
+
+    for (int c = 0; c < 4; ++c) {
+      int cx = 2 * x + (c & 1), cz = 2 * z + (c >> 1);
+      float cd = Distance(level - 1, cx, cz, eye);
+
+      if (cd <= z_far && !Use(MakeKey(level - 1, cx, cz), (levels_ - level + 1) * 1.0e6f + cd))
+        ready = false;
+    }
+
+    if (ready) {
+      for (int c = 0; c < 4; ++c)
+        Select(level - 1, 2 * x + (c & 1), 2 * z + (c >> 1), eye, z_far, draw);
+      return;
+    }
+  }
+
+  if (tile) draw.push_back(tile);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Evict
+//|
+//! \param None.
+//! \return False if every resident tile was used in the last frame.
+//|____________________________________________________________________
+
+bool Terrain::Evict()
+{
+  if (lru_.empty()) return false;
+
+  std::map<TileKey, Tile>::iterator it = tiles_.find(lru_.back());
+  if (it->second.last_frame + 1 >= frame_) return false;       // Still on screen
+
+  stats_.resident_bytes -= it->second.verts.size() * sizeof(TerrainVertex) + sizeof(Tile);
+  ++stats_.evictions;
+
+  tiles_.erase(it);
+  lru_.pop_back();
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::BeginFrame
+//|
+//! \param None.
+//! \return None.
+//!
+//! Makes the tiles loaded since the last frame resident. Least recently
+//! used tiles are evicted to stay within the budget; tiles that would
+//! exceed it are dropped and requested again later.
+//|____________________________________________________________________
+
+void Terrain::BeginFrame()
+{
+  if (!IsOpen()) return;
+
+  ++frame_;
+  stats_.tiles_drawn = 0;
+
+  std::vector<Loaded> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done.swap(done_);
+  }
+
+  double now = NowMs();
+
+  for (size_t i = 0; i < done.size(); ++i) {
+    Loaded& loaded = done[i];
+    if (tiles_.count(loaded.key)) continue;
+
+    size_t bytes = loaded.verts.size() * sizeof(TerrainVertex) + sizeof(Tile);
+
+    while (stats_.resident_bytes + bytes > budget_bytes_ && Evict()) {}
+
+    if (stats_.resident_bytes + bytes > budget_bytes_) {
+      ++stats_.dropped;
+      continue;
+    }
+
+    Tile& tile = tiles_[loaded.key];
+    tile.verts.swap(loaded.verts);
+    tile.last_frame = frame_;
+    lru_.push_front(loaded.key);
+    tile.lru = lru_.begin();
+
+    stats_.resident_bytes += bytes;
+    ++stats_.loads;
+
+    std::map<TileKey, double>::iterator req = request_time_.find(loaded.key);
+    if (req != request_time_.end()) {
+      stats_.last_latency_ms = now - req->second;
+      stats_.max_latency_ms  = std::max(stats_.max_latency_ms, stats_.last_latency_ms);
+      latency_sum_ms_       += stats_.last_latency_ms;
+      ++latency_samples_;
+      stats_.avg_latency_ms  = latency_sum_ms_ / latency_samples_;
+      request_time_.erase(req);
+    }
+  }
+
+  stats_.resident_tiles = (int) tiles_.size();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::Draw
+//|
+//! \param viewport    [in] Viewport whose camera drives the LOD selection.
+//! \param stats       [in,out] Frame counters the draws are added to.
+//! \return None.
+//|____________________________________________________________________
+
+void Terrain::Draw(const Viewport& viewport, RenderStats& stats)
+{
+  if (!IsOpen()) return;
+
+  // Camera position: translation of C = (V^-1)^-1 = -R^T * t
+  const float* m = viewport.view_mat.mData;
+  float eye[3];
+  for (int i = 0; i < 3; ++i)
+    eye[i] = -(m[i*4] * m[12] + m[i*4 + 1] * m[13] + m[i*4 + 2] * m[14]);
+
+  std::vector<const Tile*> draw;
+  Select(levels_ - 1, 0, 0, eye, viewport.z_far, draw);
+
+  LoadViewport(viewport);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  for (size_t i = 0; i < draw.size(); ++i) {
+    const TerrainVertex* v = &draw[i]->verts[0];
+
+    glVertexPointer(3, GL_FLOAT, sizeof(TerrainVertex), v->pos);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TerrainVertex), v->col);
+    glDrawElements(GL_TRIANGLES, (GLsizei) indices_.size(), GL_UNSIGNED_SHORT, &indices_[0]);
+  }
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  stats_.tiles_drawn += (int) draw.size();
+
+  // Viewport setup, switch to vertex arrays, one glDrawElements per tile
+  ++stats.viewport_changes;
+  ++stats.matrix_loads;
+  ++stats.pipeline_changes;
+  stats.draw_calls += (int) draw.size();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::EndFrame
+//|
+//! \param None.
+//! \return None.
+//!
+//! Replaces the I/O queue with the tiles missing this frame, so tiles
+//! that went out of view are never loaded.
+//|____________________________________________________________________
+
+void Terrain::EndFrame()
+{
+  if (!IsOpen()) return;
+
+  std::sort(requests_.begin(), requests_.end());
+
+  std::set<TileKey>    wanted;
+  std::vector<TileKey> queue;
+
+  for (size_t i = 0; i < requests_.size(); ++i)
+    if (wanted.insert(requests_[i].second).second) queue.push_back(requests_[i].second);
+  requests_.clear();
+
+  std::reverse(queue.begin(), queue.end());          // Highest priority at the back
+
+  // Forget tiles that are no longer wanted
+  for (std::map<TileKey, double>::iterator it = request_time_.begin(); it != request_time_.end(); ) {
+    if (wanted.count(it->first)) ++it;
+    else                         request_time_.erase(it++);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::set<TileKey> in_flight;
+    if (busy_) in_flight.insert(loading_);
+    for (size_t i = 0; i < done_.size(); ++i) in_flight.insert(done_[i].key);
+
+    queue_.clear();
+    for (size_t i = 0; i < queue.size(); ++i)
+      if (!in_flight.count(queue[i])) queue_.push_back(queue[i]);
+  }
+  cond_.notify_one();
+
+  stats_.pending_tiles = (int) request_time_.size();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Terrain::IoThread
+//|
+//! \param None.
+//! \return None.
+//!
+//! Builds requested tiles from the mapped heightmap, one at a time.
+//|____________________________________________________________________
+
+void Terrain::IoThread()
+{
+  for (;;) {
+    Loaded loaded;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!quit_ && queue_.empty()) cond_.wait(lock);
+      if (quit_) return;
+
+      loaded.key = queue_.back();
+      queue_.pop_back();
+      loading_ = loaded.key;
+      busy_    = true;
+    }
+
+    BuildTile(loaded.key, loaded.verts);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.push_back(Loaded());
+      done_.back().key = loaded.key;
+      done_.back().verts.swap(loaded.verts);
+      busy_ = false;
+    }
+  }
+}
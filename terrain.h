@@ -0,0 +1,175 @@
+//|___________________________________________________________________
+//!
+//! \file terrain.h
+//!
+//! \brief Streaming tiled terrain.
+//!
+//! The heightmap lives in a memory-mapped file and is split into a
+//! quadtree of tiles. The file is never mapped whole: the I/O thread maps
+//! the rows each tile reads, so it can exceed the address space. Every tile has the same number of vertices; a tile
+//! at level l samples the heightmap every 2^l cells, so level 0 tiles are
+//! full resolution and the root covers the whole map. Each viewport picks
+//! its tiles by distance from its camera. Missing tiles are built on a
+//! background I/O thread and kept in an LRU cache with a hard memory
+//! budget; until they arrive, their coarser parent is drawn instead.
+//|___________________________________________________________________
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glut.h>
+
+#include "mapped_file.h"
+#include "render_queue.h"
+
+//|___________________
+//|
+//| Types
+//|___________________
+
+// Heightmap file layout: header followed by size*size unsigned 16-bit
+// samples, row by row (z major). size - 1 must be TILE_CELLS * 2^n.
+struct HeightmapHeader
+{
+  char         magic[4];        // "HMAP"
+  unsigned int size;            // Samples per side
+  float        cell_size;       // World units between samples
+  float        height_scale;    // World height of sample value 65535
+};
+
+struct TerrainVertex
+{
+  float         pos[3];
+  unsigned char col[4];
+};
+
+// Counters, sizes in bytes and latencies in ms
+struct TerrainStats
+{
+  int    resident_tiles;
+  size_t resident_bytes;
+  size_t budget_bytes;
+  int    pending_tiles;         // Requested, not resident yet
+  int    tiles_drawn;           // This frame, all viewports
+  int    loads;                 // Total tiles loaded
+  int    evictions;             // Total tiles evicted
+  int    dropped;               // Loaded tiles discarded because of the budget
+  double last_latency_ms;       // Request to resident, last tile
+  double avg_latency_ms;
+  double max_latency_ms;
+};
+
+//|____________________________________________________________________
+//|
+//| Class: Terrain
+//|____________________________________________________________________
+
+class Terrain
+{
+public:
+  static const int TILE_CELLS = 64;   // Cells per tile side (TILE_CELLS + 1 vertices)
+
+  Terrain();
+  ~Terrain();
+
+  //! Writes a procedural heightmap file of size x size samples.
+  static bool CreateHeightmap(const char* path, unsigned int size, float cell_size, float height_scale);
+
+  //! Maps the heightmap, centers it on the world origin at base_height,
+  //! and starts the I/O thread.
+  bool Open(const char* path, float base_height, size_t budget_bytes);
+  void Close();
+
+  bool IsOpen() const { return levels_ > 0; }
+
+  void BeginFrame();                                        // Takes in loaded tiles, evicts over budget
+  void Draw(const Viewport& viewport, RenderStats& stats);  // Selects LOD for the viewport's camera, draws, counts the GL work
+  void EndFrame();                                          // Hands this frame's missing tiles to the I/O thread
+
+  const TerrainStats& Stats() const { return stats_; }
+
+private:
+  typedef unsigned long long TileKey;
+
+  struct Tile
+  {
+    std::vector<TerrainVertex>   verts;
+    std::list<TileKey>::iterator lru;     // Position in lru_ (front = most recent)
+    unsigned int                 last_frame;
+  };
+
+  struct Loaded
+  {
+    TileKey                    key;
+    std::vector<TerrainVertex> verts;
+  };
+
+  // Heightmap rows read by one tile: its grid plus one (level) cell around it
+  struct TileRows
+  {
+    MappedView            views[TILE_CELLS + 3];
+    const unsigned short* rows[TILE_CELLS + 3];  // k: sample row sz0 + (k - 1) * stride, clamped, from x_lo
+    int                   sz0, stride, x_lo;
+  };
+
+  static TileKey MakeKey(int level, int x, int z);
+  static void    SplitKey(TileKey key, int& level, int& x, int& z);
+
+  void  BuildIndices();
+  void  BuildTile(TileKey key, std::vector<TerrainVertex>& verts) const;
+  void  MapRows(int sx0, int sz0, int stride, TileRows& rows) const;
+  float Height(const TileRows& rows, int sx, int sz) const;
+  float Distance(int level, int x, int z, const float* eye) const;
+
+  void  Select(int level, int x, int z, const float* eye, float z_far, std::vector<const Tile*>& draw);
+  const Tile* Use(TileKey key, float priority);
+  bool  Evict();
+
+  void  IoThread();
+
+  MappedFile                      file_;
+  unsigned int                    size_;
+  float                           cell_size_;
+  float                           height_scale_;
+  float                           base_height_;
+  float                           origin_;         // World x/z of sample 0
+  int                             levels_;         // Quadtree depth, 0 when closed
+
+  std::vector<GLushort>           indices_;        // Shared by all tiles
+  std::map<TileKey, Tile>         tiles_;
+  std::list<TileKey>              lru_;
+  size_t                          budget_bytes_;
+  unsigned int                    frame_;
+
+  // Missing tiles of this frame (priority, key) and when they were first requested
+  std::vector<std::pair<float, TileKey> > requests_;
+  std::map<TileKey, double>       request_time_;
+
+  // Shared with the I/O thread
+  std::thread                     io_thread_;
+  std::mutex                      mutex_;
+  std::condition_variable         cond_;
+  std::vector<TileKey>            queue_;          // Next tile to load at the back
+  std::vector<Loaded>             done_;
+  TileKey                         loading_;
+  bool                            busy_;
+  bool                            quit_;
+
+  TerrainStats                    stats_;
+  double                          latency_sum_ms_;
+  int                             latency_samples_; // Loads still timed from their request
+};
+
+#endif // TERRAIN_H